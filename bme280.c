@@ -2,480 +2,949 @@
 //Has I2C and SPI interfaces (4- or 3-wire SPI intefaces are supported).
 //3-wire uses SDI for both input and output (must write "1" to spi3w_en register)
 //SDO is not used (not connected)
-//gcc -O3 -o bme280 bme280.cpp -li2c
+//This tool talks I2C through i2c-dev (/dev/i2c-1) or 4-wire SPI through spidev (/dev/spidev0.0), see bme280_spi.h
+//gcc -O3 -o bme280 bme280.c bme280_batch.c bme280_emu.c bme280_window.c bme280_http.c bme280_push.c bme280_instr.c bme280_profile.c bme280_filter.c bme280_ring.c bme280_capture.c bme280_spi.c bme280_deadband.c -li2c -lrt -lpthread -lm
+//gcc -O3 -o bme280c bme280c.c -lrt
+//gcc -O3 -o bme280log bme280log.c
+//gcc -O3 -o bme280stream bme280stream.c
 
 #define I2C_DEV_RETRIES 3
+#define I2C_IO_RETRIES 2 //transactions failing with a transient error are repeated this many times, see readRegister()
 #define I2C_TIMEOUT 100 //in 10ms intervals
 #define DEFAULT_SAMPLING_RATE_SEC 1
+#define JITTER_BUCKETS 24 //wake-up lateness histogram, bucket i counts [2^(i-1), 2^i) us
 #define DEFAULT_NUMBER_OF_SAMPLES 1
+#define MAX_DEVICES 16
+#define BME280_CACHE_DIR "/var/cache/bme280" //calibration and settings cache, see setup(), created private to the user
+#define BME280_EMU_DEVICE "emu" //i2c-dev name of the emulated sensor
+#define BME280_EMU_SPI_DEVICE "emu-spi" //spidev name of the emulated sensor
+#define BENCH_SAMPLES 4096 //samples per kernel benchmark pass
+#define BENCH_MIN_NS 200000000 //each benchmark runs at least this long
+#define BME280_CACHE_MAGIC 0x42453202 //"BE2" + cache format version
+//outputs, those in --filtered get the filtered samples, the others the sensor's
+#define OUTPUT_PRINT 1
+#define OUTPUT_LOG 2
+#define OUTPUT_PUSH 4
+#define OUTPUT_SHM 8
+#define OUTPUT_METRICS 16
+#define OUTPUT_WINDOW 32
+#define OUTPUT_STREAM 64
+#define OUTPUT_FILTERED_DEFAULT (OUTPUT_PRINT | OUTPUT_LOG | OUTPUT_PUSH | OUTPUT_WINDOW | OUTPUT_STREAM)
+#define WRITER_QUEUE 1024 //samples waiting for the writer thread, see --queue
+#define WRITER_BATCH 64 //samples written between flushes
+#define WRITER_BUFFER 65536 //stdout buffer
+#define CAPTURE_SCAN_RECORDS 256 //records looked at for the devices and sampling interval of a replay
 
 #include <errno.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
-//#include <linux/i2c.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <i2c/smbus.h>
+#include "bme280.h"
+#include "bme280_batch.h"
+#include "bme280_emu.h"
+#include "bme280_window.h"
+#include "bme280_filter.h"
+#include "bme280_ring.h"
+#include "bme280_capture.h"
+#include "bme280_spi.h"
+#include "bme280_deadband.h"
+#include "bme280_stream.h"
+#include "bme280_http.h"
+#include "bme280_push.h"
+#include "bme280_instr.h"
+#include "bme280_profile.h"
+#include "bme280_shm.h"
+#include "bme280_log.h"
 
-//to enable SPI and disable i2c, CSB (chip select) -> GND
-#define BME280_I2C_ADDR_PRIM 0x76 //
-#define BME280_I2C_ADDR_SEC 0x77 //to change primary addr to secondary, SDO -> GND
-
-#define BME280_CHIP_ID 0x60
-
-//name Register Address
-#define BME280_CHIP_ID_ADDR 0xD0
-#define BME280_RESET_ADDR 0xE0
-#define BME280_TEMP_PRESS_CALIB_DATA_ADDR 0x88
-#define BME280_HUMIDITY_CALIB_DATA_ADDR 0xE1
-#define BME280_PWR_CTRL_ADDR 0xF4
-#define BME280_STATUS_ADDR 0xF3
-#define BME280_CTRL_HUM_ADDR 0xF2
-#define BME280_CTRL_MEAS_ADDR 0xF4
-#define BME280_CONFIG_ADDR 0xF5
-#define BME280_DATA_ADDR 0xF7
-
-#define BME280_TEMP_PRESS_CALIB_DATA_LEN 26
-#define BME280_HUMIDITY_CALIB_DATA_LEN 7
-#define BME280_P_T_H_DATA_LEN 8
-
-#define BME280_SENSOR_MODE_MSK 3
-#define BME280_SENSOR_MODE_POS 0
-#define BME280_CTRL_HUM_MSK 7
-#define BME280_CTRL_HUM_POS 0
-#define BME280_CTRL_PRESS_MSK 0x1C
-#define BME280_CTRL_PRESS_POS 2
-#define BME280_CTRL_TEMP_MSK 0xE0
-#define BME280_CTRL_TEMP_POS 5
-#define BME280_FILTER_MSK 0x1C
-#define BME280_FILTER_POS 2
-#define BME280_STANDBY_MSK 0xE0
-#define BME280_STANDBY_POS 5
-
-#define BME280_OSR_PRESS_SEL 1
-#define BME280_OSR_TEMP_SEL 2
-#define BME280_OSR_HUM_SEL 4
-#define BME280_FILTER_SEL 8
-#define BME280_STANDBY_SEL 16
-#define BME280_ALL_SETTINGS_SEL 0x1F
-
-#define BME280_NO_OVERSAMPLING 0x00
-#define BME280_OVERSAMPLING_1X 0x01
-#define BME280_OVERSAMPLING_2X 0x02
-#define BME280_OVERSAMPLING_4X 0x03
-#define BME280_OVERSAMPLING_8X 0x04
-#define BME280_OVERSAMPLING_16X 0x05
-
-#define BME280_FILTER_COEFF_OFF 0x00
-#define BME280_FILTER_COEFF_2 0x01
-#define BME280_FILTER_COEFF_4 0x02
-#define BME280_FILTER_COEFF_8 0x03
-#define BME280_FILTER_COEFF_16 0x04
-
-#define BME280_STANDBY_TIME_0_5_MS 0
-#define BME280_STANDBY_TIME_62_5_MS 1
-#define BME280_STANDBY_TIME_125_MS 2
-#define BME280_STANDBY_TIME_250_MS 3
-#define BME280_STANDBY_TIME_500_MS 4
-#define BME280_STANDBY_TIME_1000_MS 5
-#define BME280_STANDBY_TIME_10_MS 6
-#define BME280_STANDBY_TIME_20_MS 7
-
-#define BME280_SLEEP_MODE 0x00
-#define BME280_FORCED_MODE 0x01
-#define BME280_NORMAL_MODE 0x03
-
-#define BME280_PRESS 1
-#define BME280_TEMP 2
-#define BME280_HUM 4
-#define BME280_ALL 0x07
-
-#define OVERSAMPLING_SETTINGS 7
-#define FILTER_STANDBY_SETTINGS 0x18
-
-struct Settings
+//register read methods, fastest first
+#define I2C_XFER_RDWR 0 //one combined write/read I2C_RDWR transaction per register range
+#define I2C_XFER_SMBUS_BLOCK 1 //smbus i2c block reads, up to I2C_SMBUS_BLOCK_MAX bytes each
+#define I2C_XFER_SMBUS_BYTE 2 //one smbus byte read per register
+#define SPI_XFER 3 //one spidev transfer per register range or run of writes, the only method of an SPI device
+
+//calibration never changes and settings are only changed by us, so they are cached on disk between runs
+struct Cache
 {
-	uint8_t osr_p; //pressure oversampling
-	uint8_t osr_t; //temperature oversampling
-	uint8_t osr_h; //humidity oversampling
-	uint8_t filter; //filter coefficient
-	uint8_t standby_time; //standby time
-} settings;
-struct Data
+	uint32_t magic;
+	uint8_t chipId;
+	uint8_t addr;
+	struct Settings settings; //settings applied when the cache was written
+	struct CalibData calibData;
+};
+
+const char * cacheDir = BME280_CACHE_DIR;
+
+struct Device;
+
+//register access of a device, see i2cTransport, emuTransport and spiTransport
+struct Transport
 {
-	uint32_t p; //pressure
-	int32_t t; //temperature
-	uint32_t h; //humidity
+	int (*read)(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len); //returns number of registers read
+	int (*write)(struct Device * dev, uint16_t addr, uint8_t val); //returns 0 on success
+	int (*writeRegs)(struct Device * dev, const uint8_t * regs, uint8_t n); //n address and value pairs in one transaction, NULL if the bus cannot
 };
-struct UncompData
+
+//one sensor, several of them may share a bus
+struct Device
 {
-	uint32_t p; //pressure
-	uint32_t t; //temperature
-	uint32_t h; //humidity
+	const struct Transport * transport;
+	void * priv; //transport state, i.e. struct Emu
+	char bus[16]; //i2c-dev or spidev, i.e. /dev/i2c-1 or /dev/spidev0.0
+	int fd;
+	uint16_t addr;
+	uint8_t xfer; //register read method, I2C_XFER_*
+	uint8_t regs[4]; //shadow copy of ctrl_hum, status, ctrl_meas and config registers as last read or written, see applySettings()
+	bool regsValid; //regs hold what the sensor holds, status excepted
+	uint8_t mode; //BME280_NORMAL_MODE or BME280_FORCED_MODE, see setup()
+	struct Settings settings; //applied by setup()
+	struct Profile profile; //profile the settings and mode come from, see bme280_profile.h
+	bool reload; //profile has changed, it is applied by reconfigure() before the next sample
+	struct CalibData calibData;
+	struct timespec dataReadyAt; //CLOCK_MONOTONIC time when the first conversion after setup() completes
+	struct UncompData raw; //latest sample before compensation
+	struct Data data; //latest sample
+	bool ok; //latest sample was read successfully
+	bool burst; //regData holds the latest data registers read, a corrupt sample too
+	uint8_t regData[BME280_P_T_H_DATA_LEN];
+	uint8_t calib[CAPTURE_CALIB_LEN]; //calibration registers as read, with --capture
+	bool calibRead; //calib is valid, until it is the samples are not captured and the read is retried every sweep
+	struct Filter filter; //--filter state
+	struct Instr instr; //bus transaction statistics, see readRegister() and writeRegister()
 };
-struct CalibData
+
+//one sample of a sweep on its way from the sampling loop to the writer thread
+struct OutputSample
 {
-	uint16_t dig_T1;
-	int16_t dig_T2;
-	int16_t dig_T3;
-	uint16_t dig_P1;
-	int16_t dig_P2;
-	int16_t dig_P3;
-	int16_t dig_P4;
-	int16_t dig_P5;
-	int16_t dig_P6;
-	int16_t dig_P7;
-	int16_t dig_P8;
-	int16_t dig_P9;
-	uint8_t dig_H1;
-	int16_t dig_H2;
-	uint8_t dig_H3;
-	int16_t dig_H4;
-	int16_t dig_H5;
-	int8_t dig_H6;
-	int32_t t_fine;
-} calibData;
-
-void setSettings(int fd, uint8_t sets);
-
-int readRegister(int fd, uint16_t addr, uint8_t * buf, uint16_t len) {
-	int i;
-	for (i = 0; i < len; i++)
-		buf[i] = i2c_smbus_read_byte_data(fd, addr + i);
-	return i;		
+	int64_t time_ns; //CLOCK_REALTIME of the sweep
+	int dev; //index in the devices
+	bool ok; //false for a corrupt sample, which is only captured
+	bool calibRead; //calibration registers of the device are known, see struct Device
+	uint8_t regs[4]; //ctrl_hum, status, ctrl_meas and config the sample was measured with
+	uint8_t regData[BME280_P_T_H_DATA_LEN];
+	struct UncompData raw;
+	struct Data data;
+	struct Data filtered; //with --filter
+};
+
+//the driver core runs on the transport of the device
+int readRegister(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len);
+int writeRegister(struct Device * dev, uint16_t addr, uint8_t val);
+int writeRegisters(struct Device * dev, const uint8_t * regs, uint8_t n);
+#define BME280_CORE_DEV struct Device *
+#define BME280_CORE_READ readRegister
+#define BME280_CORE_WRITE writeRegister
+#define BME280_CORE_WRITE_REGS writeRegisters
+#include "bme280_core.h"
+
+int readRegisterRdwr(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	uint8_t reg = addr;
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data rdwr;
+	msgs[0].addr = dev->addr; msgs[0].flags = 0; msgs[0].len = 1; msgs[0].buf = &reg;
+	msgs[1].addr = dev->addr; msgs[1].flags = I2C_M_RD; msgs[1].len = len; msgs[1].buf = buf;
+	rdwr.msgs = msgs; rdwr.nmsgs = 2;
+	if (ioctl(dev->fd, I2C_RDWR, &rdwr) < 0) return -1;
+	return len;
+}
+
+int readRegisterBlock(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	int i = 0, res;
+	while (i < len) {
+		res = i2c_smbus_read_i2c_block_data(dev->fd, addr + i, len - i > I2C_SMBUS_BLOCK_MAX ? I2C_SMBUS_BLOCK_MAX : len - i, buf + i);
+		if (res <= 0) return i > 0 ? i : -1;
+		i += res;
+	}
+	return i;
+}
+
+int readRegisterByte(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	int i, res;
+	for (i = 0; i < len; i++) {
+		if ((res = i2c_smbus_read_byte_data(dev->fd, addr + i)) < 0) break;
+		buf[i] = res;
+	}
+	return i;
+}
+
+//reads len consecutive registers starting at addr in as few bus transactions as the adapter allows
+//if the adapter rejects the selected method, falls back to the next slower one for this and all later reads
+int i2cRead(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	int res;
+	while (true) {
+		switch (dev->xfer) {
+		case I2C_XFER_RDWR: res = readRegisterRdwr(dev, addr, buf, len); break;
+		case I2C_XFER_SMBUS_BLOCK: res = readRegisterBlock(dev, addr, buf, len); break;
+		default: return readRegisterByte(dev, addr, buf, len);
+		}
+		if (res >= 0 || (errno != EOPNOTSUPP && errno != ENOTTY && errno != EINVAL)) return res;
+		dev->xfer++;
+	}
+}
+
+int i2cWrite(struct Device * dev, uint16_t addr, uint8_t val) {
+	return i2c_smbus_write_byte_data(dev->fd, addr, val);
+}
+
+const struct Transport i2cTransport = { i2cRead, i2cWrite, NULL };
+
+//dev->priv is a struct Emu, reads are split into bus transactions the way the selected dev->xfer method splits them on an adapter
+int emuRead(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	uint16_t chunk = dev->xfer == I2C_XFER_SMBUS_BYTE ? 1 : dev->xfer == I2C_XFER_SMBUS_BLOCK ? I2C_SMBUS_BLOCK_MAX : len;
+	int i = 0;
+	while (i < len) {
+		if (chunk > len - i) chunk = len - i;
+		if (readEmu(dev->priv, addr + i, buf + i, chunk) < 0) return i > 0 ? i : -1;
+		i += chunk;
+	}
+	return i;
+}
+
+int emuWrite(struct Device * dev, uint16_t addr, uint8_t val) {
+	return writeEmu(dev->priv, addr, val);
+}
+
+const struct Transport emuTransport = { emuRead, emuWrite, NULL };
+
+//dev->priv is a struct Spi, on spidev or the software sensor
+int spiRead(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	return readSpi(dev->priv, addr, buf, len);
+}
+
+int spiWrite(struct Device * dev, uint16_t addr, uint8_t val) {
+	uint8_t reg[2] = { addr, val };
+	return writeSpi(dev->priv, reg, 1);
+}
+
+int spiWriteRegs(struct Device * dev, const uint8_t * regs, uint8_t n) {
+	return writeSpi(dev->priv, regs, n);
+}
+
+const struct Transport spiTransport = { spiRead, spiWrite, spiWriteRegs };
+
+uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//a NACK, a timeout or a lost arbitration the adapter did not retry itself may succeed when repeated
+bool isTransientError(int err) {
+	return err == EREMOTEIO || err == EIO || err == ETIMEDOUT || err == EAGAIN || err == ENXIO;
+}
+
+//both are timed and counted in dev->instr, a fallback to a slower read method counts as a retry
+int readRegister(struct Device * dev, uint16_t addr, uint8_t * buf, uint16_t len) {
+	uint64_t start = nowNs();
+	uint8_t xfer = dev->xfer;
+	uint32_t retries = 0;
+	int res;
+	while ((res = dev->transport->read(dev, addr, buf, len)) != len && retries < I2C_IO_RETRIES && isTransientError(errno)) retries++;
+	recordInstr(&dev->instr, getInstrOp(addr, false), nowNs() - start, retries + dev->xfer - xfer, res == len);
+	return res;
+}
+
+int writeRegister(struct Device * dev, uint16_t addr, uint8_t val) {
+	uint64_t start = nowNs();
+	uint32_t retries = 0;
+	int res;
+	while ((res = dev->transport->write(dev, addr, val)) != 0 && retries < I2C_IO_RETRIES && isTransientError(errno)) retries++;
+	recordInstr(&dev->instr, getInstrOp(addr, true), nowNs() - start, retries, res == 0);
+	return res;
 }
 
-int writeRegister(int fd, uint16_t addr, uint8_t val) {
-	return i2c_smbus_write_byte_data(fd, addr, val);
+//one transaction if the transport has it, otherwise a writeRegister() per pair
+int writeRegisters(struct Device * dev, const uint8_t * regs, uint8_t n) {
+	if (!dev->transport->writeRegs) {
+		for (int i = 0; i < n; i++)
+			if (writeRegister(dev, regs[2 * i], regs[2 * i + 1]) != 0) return -1;
+		return 0;
+	}
+	uint64_t start = nowNs();
+	uint32_t retries = 0;
+	int res;
+	while ((res = dev->transport->writeRegs(dev, regs, n)) != 0 && retries < I2C_IO_RETRIES && isTransientError(errno)) retries++;
+	recordInstr(&dev->instr, getInstrOp(regs[0], true), nowNs() - start, retries, res == 0);
+	return res;
 }
 
-uint8_t getChipId(int fd) {
+uint8_t getChipId(struct Device * dev) {
 	uint8_t chipId = 0;
-	readRegister(fd, BME280_CHIP_ID_ADDR, &chipId, 1);
+	if (readRegister(dev, BME280_CHIP_ID_ADDR, &chipId, 1) != 1) {
+		printf("getChipId error: %s\n", strerror(errno));
+		return 0;
+	}
 	if (chipId != BME280_CHIP_ID) {
 		printf("getChipId error: wrong id %#hhX, expected %#hhX\n", chipId, BME280_CHIP_ID);
 	}
 	return chipId;
 }
 
-void setHumiditySettings(int fd) {
-	uint8_t ctrl_meas, err;
-	uint8_t ctrl_hum = settings.osr_h & BME280_CTRL_HUM_MSK;
-	if ((err = writeRegister(fd, BME280_CTRL_HUM_ADDR, ctrl_hum)) != 0) {
-		printf("setHumiditySettings() writeRegister error %hhd\n", err);
-		return;
+void addUs(struct timespec * ts, uint64_t us) {
+	ts->tv_sec += us / 1000000;
+	ts->tv_nsec += (us % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
 	}
-	//must write to ctrl_meas register to activate humidity settings
-	if (readRegister(fd, BME280_CTRL_MEAS_ADDR, &ctrl_meas, 1) != 1) {
-		printf("setHumiditySettings() readRegister error\n");
-		return;
+}
+
+void sleepUs(uint32_t us) {
+	struct timespec req = { us / 1000000, (us % 1000000) * 1000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &req, &req) == EINTR);
+}
+
+//polls the status register until all bits in mask are cleared, backing off from BME280_POLL_MIN_US to BME280_POLL_MAX_US
+//returns false on timeout or read error
+bool waitForStatus(struct Device * dev, uint8_t mask, uint32_t timeout_us) {
+	struct timespec now, deadline;
+	uint8_t status;
+	uint32_t backoff = BME280_POLL_MIN_US;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	addUs(&deadline, timeout_us);
+	while (true) {
+		if (readRegister(dev, BME280_STATUS_ADDR, &status, 1) != 1) return false;
+		if ((status & mask) == 0) return true;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) return false;
+		sleepUs(backoff);
+		if (backoff < BME280_POLL_MAX_US) backoff <<= 1;
 	}
-	if ((err = writeRegister(fd, BME280_CTRL_MEAS_ADDR, ctrl_meas)) != 0)
-		printf("setHumiditySettings() writeRegister2 error %hhd\n", err);
 }
 
-void setPressTempSettings(int fd, uint8_t sets) {
-	uint8_t regData, err;
-	if (readRegister(fd, BME280_CTRL_MEAS_ADDR, &regData, 1) != 1) {
-		printf("setPressTempSettings() readRegister error\n");
+void softReset(struct Device * dev) {
+	int err;
+	//printf("Resetting...\n");
+	if ((err = writeRegister(dev, BME280_RESET_ADDR, 0xB6)) != 0)
+		printf("softReset() writeRegister error %d\n", err);
+	//the sensor does not respond until it is started up, then it copies calibration data from NVM
+	sleepUs(BME280_STARTUP_TIME_US);
+	if (!waitForStatus(dev, BME280_STATUS_IM_UPDATE_MSK, BME280_RESET_TIMEOUT_US)) {
+		printf("softReset() waitForStatus timeout\n");
+		dev->regsValid = false;
 		return;
 	}
-	if (sets & BME280_OSR_PRESS_SEL)
-		regData = (regData & (~BME280_CTRL_PRESS_MSK)) | ((settings.osr_p << BME280_CTRL_PRESS_POS) & BME280_CTRL_PRESS_MSK);
-	if (sets & BME280_OSR_TEMP_SEL)
-		regData = (regData & (~BME280_CTRL_TEMP_MSK)) | ((settings.osr_t << BME280_CTRL_TEMP_POS) & BME280_CTRL_TEMP_MSK);
-	if ((err = writeRegister(fd, BME280_CTRL_MEAS_ADDR, regData)) != 0)
-		printf("setPressTempSettings() writeRegister error %hhd\n", err);
+	//registers are at their reset values, all zero, and need not be read
+	memset(dev->regs, 0, sizeof(dev->regs));
+	dev->regsValid = err == 0;
 }
 
-uint8_t getMode(int fd) {
-	uint8_t mode;
-	if (readRegister(fd, BME280_PWR_CTRL_ADDR, &mode, 1) != 1) {
-		printf("getMode() readRegister error\n");
-		return 4; //not such mode     
+//reads ctrl_hum, status, ctrl_meas and config registers into the shadow copy
+bool readShadowRegs(struct Device * dev) {
+	dev->regsValid = readRegister(dev, BME280_CTRL_HUM_ADDR, dev->regs, 4) == 4;
+	return dev->regsValid;
+}
+
+//writeSettings() of the driver core on the shadow copy of dev, which is re-read first if a write failed before
+bool applySettings(struct Device * dev, const struct Settings * sets, uint8_t mode) {
+	if (!dev->regsValid && !readShadowRegs(dev)) {
+		printf("applySettings() readRegister error\n");
+		return false;
+	}
+	if (!writeSettings(dev, dev->regs, sets, mode)) {
+		printf("applySettings() writeRegister error %s\n", strerror(errno));
+		dev->regsValid = false;
+		return false;
 	}
-	mode &= BME280_SENSOR_MODE_MSK;
-	return mode;
+	return true;
 }
 
-void parseSettings(const uint8_t* regData, struct Settings* sets) {
-	sets->osr_h = regData[0] & BME280_CTRL_HUM_MSK;
-	sets->osr_p = (regData[2] & BME280_CTRL_PRESS_MSK) >> BME280_CTRL_PRESS_POS;
-	sets->osr_t = (regData[2] & BME280_CTRL_TEMP_MSK) >> BME280_CTRL_TEMP_POS;
-	sets->filter = (regData[3] & BME280_FILTER_MSK) >> BME280_FILTER_POS;
-	sets->standby_time = (regData[3] & BME280_STANDBY_MSK) >> BME280_STANDBY_POS;
+//compensates the data registers of a sample, as read or replayed, with the calibration of dev,
+//a corrupt burst is counted and fails instead of being compensated into plausible values
+bool compensateBurst(struct Device * dev, const uint8_t * regData, uint8_t dataType, struct Data * data) {
+	struct UncompData uncompData = { 0, 0, 0 };
+	parseData(regData, &uncompData);
+	if (isCorrupt(&dev->settings, regData, &uncompData)) {
+		atomic_fetch_add_explicit(&dev->instr.corrupt, 1, memory_order_relaxed);
+		fprintf(stderr, "compensateBurst() corrupt sample %02x%02x%02x %02x%02x%02x %02x%02x\n", regData[0], regData[1], regData[2], regData[3], regData[4], regData[5], regData[6], regData[7]);
+		return false;
+	}
+	compensateData(dataType, &uncompData, data, &dev->calibData);
+	dev->raw = uncompData;
+	return true;
 }
 
-void softReset(int fd) {
-	uint8_t err;
-	//printf("Resetting...\n");
-	if ((err = writeRegister(fd, BME280_RESET_ADDR, 0xB6)) != 0)
-		printf("softReset() writeRegister error %hhd\n", err);
-	struct timespec req;
-	//req.tv_sec = 0; req.tv_nsec = 2000000;
-	//nanosleep(&req, NULL);
-	sleep(1);
-}
-
-void reloadSettings(int fd, const struct Settings* sets) {
-	setSettings(fd, BME280_ALL_SETTINGS_SEL);
-	uint8_t regData = 0, err;
-	if (readRegister(fd, BME280_CONFIG_ADDR, &regData, 1) != 1) {
-		printf("reloadSettings() readRegister error\n");
-		return;
+bool getData(struct Device * dev, uint8_t dataType, struct Data * data) {
+	struct UncompData uncompData;
+	dev->burst = readData(dev, dev->regData, &uncompData);
+	if (!dev->burst) {
+		printf("getData() readRegister error\n");
+		return false;
+	}
+	return compensateBurst(dev, dev->regData, dataType, data);
+}
+
+//the calibration registers as they are, not parsed, for --capture
+bool getCalibRegs(struct Device * dev, uint8_t * calib) {
+	if (readRegister(dev, BME280_TEMP_PRESS_CALIB_DATA_ADDR, calib, BME280_TEMP_PRESS_CALIB_DATA_LEN) != BME280_TEMP_PRESS_CALIB_DATA_LEN ||
+		readRegister(dev, BME280_HUMIDITY_CALIB_DATA_ADDR, calib + BME280_TEMP_PRESS_CALIB_DATA_LEN, BME280_HUMIDITY_CALIB_DATA_LEN) != BME280_HUMIDITY_CALIB_DATA_LEN) {
+		printf("getCalibRegs() readRegister error\n");
+		return false;
+	}
+	return true;
+}
+
+bool getCalibData(struct Device * dev, struct CalibData * calibData) {
+	if (!readCalibData(dev, calibData)) {
+		printf("getCalibData() readRegister error\n");
+		return false;
 	}
-	regData = (regData & (~BME280_FILTER_MSK)) | ((sets->filter << BME280_FILTER_POS) & BME280_FILTER_MSK);
-	regData = (regData & (~BME280_STANDBY_MSK)) | ((sets->standby_time << BME280_STANDBY_POS) & BME280_STANDBY_MSK);
-	if ((err = writeRegister(fd, BME280_CONFIG_ADDR, regData)) != 0)
-		printf("reloadSettings() writeRegister error %hhd\n", err);
+	return true;
 }
 
-void setFilterStandbySettings(int fd, uint8_t sets) {
-	uint8_t regData, err;
-	if (readRegister(fd, BME280_CONFIG_ADDR, &regData, 1) != 1) {
-		printf("setFilterStandbySettings() readRegister error\n");
+//device name for output, i.e. i2c-1:76
+const char * getDeviceName(const struct Device * dev, char * name, size_t len) {
+	const char * bus = strrchr(dev->bus, '/');
+	//an SPI device is selected by its chip select, it has no address
+	if (dev->xfer == SPI_XFER) snprintf(name, len, "%s", bus ? bus + 1 : dev->bus);
+	else snprintf(name, len, "%s:%02x", bus ? bus + 1 : dev->bus, dev->addr);
+	return name;
+}
+
+//prefix is printed before the sample when several devices are sampled, see getDeviceName()
+int formatData(char * buf, size_t len, const char * prefix, const struct Data * data, bool raw) {
+	double t, p, h;
+	uint8_t deg[3] = { 0xc2, 0xb0, 0 }; //unicode degree symbol
+	t = data->t / 100.0;
+	p = data->p / 256.0;
+	h = data->h / 1024.0;
+
+	if (raw)
+		return snprintf(buf, len, "%s%s%st=%.1f&h=%.1f&p=%.1f\n", prefix ? "dev=" : "", prefix ? prefix : "", prefix ? "&" : "", t, h, p / 100);
+	else 
+		return snprintf(buf, len, "%s%sT = %.1f%sC, H = %.1f%%, P = %.1fmb(hPa) (%.1fmm Hg)\n", prefix ? prefix : "", prefix ? " " : "", t, (char *)(&deg), h, p / 100, p * 0.0075006157584566);
+}
+
+void printData(const char * prefix, const struct Data * data, bool raw) {
+	char buf[128];
+	formatData(buf, sizeof(buf), prefix, data, raw);
+	fputs(buf, stdout);
+}
+
+//the average is printed like a sample, followed by the extremes and the number of samples in the window
+void printWindow(const char * prefix, const struct WindowData * agg, bool raw) {
+	uint8_t deg[3] = { 0xc2, 0xb0, 0 }; //unicode degree symbol
+	if (raw)
+		printf("%s%s%st=%.1f&h=%.1f&p=%.1f&t_min=%.1f&t_max=%.1f&h_min=%.1f&h_max=%.1f&p_min=%.1f&p_max=%.1f&n=%u\n",
+			prefix ? "dev=" : "", prefix ? prefix : "", prefix ? "&" : "",
+			agg->avg.t / 100.0, agg->avg.h / 1024.0, agg->avg.p / 25600.0, agg->min.t / 100.0, agg->max.t / 100.0,
+			agg->min.h / 1024.0, agg->max.h / 1024.0, agg->min.p / 25600.0, agg->max.p / 25600.0, agg->count);
+	else
+		printf("%s%sT = %.1f%sC (%.1f..%.1f), H = %.1f%% (%.1f..%.1f), P = %.1fmb(hPa) (%.1f..%.1f), %u samples\n",
+			prefix ? prefix : "", prefix ? " " : "", agg->avg.t / 100.0, (char *)(&deg), agg->min.t / 100.0, agg->max.t / 100.0,
+			agg->avg.h / 1024.0, agg->min.h / 1024.0, agg->max.h / 1024.0, agg->avg.p / 25600.0, agg->min.p / 25600.0, agg->max.p / 25600.0, agg->count);
+}
+
+//cache file name is keyed by bus and address, i.e. /var/cache/bme280/bme280-i2c-1-76.cache
+void getCachePath(const struct Device * dev, char * path, size_t len) {
+	const char * bus = strrchr(dev->bus, '/');
+	bus = bus ? bus + 1 : dev->bus;
+	snprintf(path, len, "%s/bme280-%s-%02x.cache", cacheDir, bus, dev->addr);
+}
+
+//a cache file or directory another user can write to may hold planted calibration data or symlinks, it is not used
+bool isPrivate(const struct stat * st) {
+	return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+bool loadCache(const struct Device * dev, uint8_t chipId, struct Cache * cache) {
+	char path[64];
+	struct stat st;
+	if (!cacheDir) return false;
+	getCachePath(dev, path, sizeof(path));
+	int fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0) return false;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !isPrivate(&st)) {
+		printf("loadCache() %s is not a file of this user only, ignored\n", path);
+		close(fd);
+		return false;
+	}
+	FILE * f = fdopen(fd, "rb");
+	if (!f) {
+		close(fd);
+		return false;
+	}
+	size_t n = fread(cache, sizeof(struct Cache), 1, f);
+	fclose(f);
+	return n == 1 && cache->magic == BME280_CACHE_MAGIC && cache->chipId == chipId && cache->addr == dev->addr;
+}
+
+void saveCache(const struct Device * dev, uint8_t chipId) {
+	char path[64], tmp[72];
+	struct Cache cache;
+	struct stat st;
+	if (!cacheDir) return;
+	if (mkdir(cacheDir, 0700) != 0 && errno != EEXIST) return;
+	if (lstat(cacheDir, &st) != 0 || !S_ISDIR(st.st_mode) || !isPrivate(&st)) {
+		printf("saveCache() %s is not a directory of this user only, calibration data is not cached\n", cacheDir);
+		return;
+	}
+	memset(&cache, 0, sizeof(cache));
+	cache.magic = BME280_CACHE_MAGIC;
+	cache.chipId = chipId;
+	cache.addr = dev->addr;
+	cache.settings = dev->settings;
+	cache.calibData = dev->calibData;
+	getCachePath(dev, path, sizeof(path));
+	//write to a temporary file and rename it, so a concurrent run never sees a partial cache,
+	//mkstemp() creates it exclusively with mode 0600
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	int fd = mkstemp(tmp);
+	if (fd < 0) return;
+	FILE * f = fdopen(fd, "wb");
+	if (!f) {
+		close(fd);
+		unlink(tmp);
 		return;
 	}
-	if (sets & BME280_FILTER_SEL)
-		regData = (regData & (~BME280_FILTER_MSK)) | ((settings.filter << BME280_FILTER_POS) & BME280_FILTER_MSK);
-	if (sets & BME280_STANDBY_SEL)
-		regData = (regData & (~BME280_STANDBY_MSK)) | ((settings.standby_time << BME280_STANDBY_POS) & BME280_STANDBY_MSK);
-	if ((err = writeRegister(fd, BME280_CONFIG_ADDR, regData)) != 0)
-		printf("setFilterStandbySettings() writeRegister error %hhd\n", err);
+	size_t n = fwrite(&cache, sizeof(cache), 1, f);
+	if (fclose(f) != 0 || n != 1 || rename(tmp, path) != 0) unlink(tmp);
 }
 
-void setSettings(int fd, uint8_t sets) {
-	uint8_t regData[4];
+//returns true if ctrl_hum, ctrl_meas and config registers hold our settings and the sensor is
+//in NORMAL_MODE or, if dev->mode is FORCED_MODE, asleep between forced measurements
+bool isConfigured(struct Device * dev, const struct Settings * sets) {
+	if (!readShadowRegs(dev)) return false;
+	if ((dev->regs[2] & BME280_SENSOR_MODE_MSK) != (dev->mode == BME280_FORCED_MODE ? BME280_SLEEP_MODE : BME280_NORMAL_MODE)) return false;
 	struct Settings s;
-	if (getMode(fd) != BME280_SLEEP_MODE) {
-		//put dev to sleep - it is entered the sleep mode by default after power on reset
-		if (readRegister(fd, BME280_CTRL_HUM_ADDR, (uint8_t *)(&regData), 4) != 4) {
-			printf("setSettings() readRegister error\n");
-			return;
+	parseSettings(dev->regs, &s);
+	return memcmp(&s, sets, sizeof(s)) == 0;
+}
+
+//changes the settings and mode of a sensor set up by setup() while it keeps running, without a reset
+//and in as few writes as writeSettings() in bme280_core.h needs, the next sample is read once a conversion with them has completed
+bool reconfigure(struct Device * dev, const struct Settings * sets, uint8_t mode) {
+	if (!applySettings(dev, sets, mode == BME280_FORCED_MODE ? BME280_SLEEP_MODE : BME280_NORMAL_MODE)) return false;
+	dev->settings = *sets;
+	dev->mode = mode;
+	clock_gettime(CLOCK_MONOTONIC, &dev->dataReadyAt);
+	addUs(&dev->dataReadyAt, getMeasurementTimeUs(&dev->settings));
+	return true;
+}
+
+//applies dev->settings and dev->mode, see bme280_profile.c for what they trade off
+//returns true if the sensor was already running with our settings and cached calibration data was used
+bool setup(struct Device * dev) {
+	//Just to verify that we talk to the right device
+	uint8_t chipId = getChipId(dev);
+
+	//a power cycled or swapped sensor comes up in SLEEP_MODE with ctrl registers cleared,
+	//so it never passes isConfigured() and its calibration is re-read
+	//a sensor still running with the cached settings is the cached one, if our settings differ it is reconfigured without a reset
+	struct Cache cache;
+	if (loadCache(dev, chipId, &cache) && isConfigured(dev, &cache.settings)) {
+		dev->calibData = cache.calibData;
+		if (memcmp(&cache.settings, &dev->settings, sizeof(dev->settings)) == 0) return true;
+		if (reconfigure(dev, &dev->settings, dev->mode)) {
+			saveCache(dev, chipId);
+			return false;
 		}
-		parseSettings(regData, &s);
-		softReset(fd);
-		reloadSettings(fd, &s);
 	}
-	if (sets & BME280_OSR_HUM_SEL) setHumiditySettings(fd);
-	if (sets & (BME280_OSR_PRESS_SEL | BME280_OSR_TEMP_SEL)) setPressTempSettings(fd, sets);
-	if (sets & (BME280_FILTER_SEL | BME280_STANDBY_SEL)) setFilterStandbySettings(fd, sets);
+	softReset(dev);
+	bool calibOk = getCalibData(dev, &dev->calibData);
+
+	//there are three modes: SLEEP, FORCED and NORMAL
+	//in SLEEP_MODE all registers are accessible but no measurements are done; hence, the power consumption is minimum
+	//in FORCED_MODE a single measurement is done in accordance with the selected measurements and filter options, then the sensor enters the SLEEP_MODE
+	//for the next measurement the FORCED_MODE needs to be selected again
+	//in NORMAL_MODE the sensor cycling between active and standby periods. The standby_time can be selected between 0.5 and 1000ms
+	//in NORMAL_MODE data is always accessible without the need for further write accesses
+	//NORMAL_MODE is recommended when using IIR filter to filter short-term environmental disturbances
+	//in FORCED_MODE the sensor is left asleep, see startForced()
+	applySettings(dev, &dev->settings, dev->mode == BME280_FORCED_MODE ? BME280_SLEEP_MODE : BME280_NORMAL_MODE);
+	clock_gettime(CLOCK_MONOTONIC, &dev->dataReadyAt);
+	addUs(&dev->dataReadyAt, getMeasurementTimeUs(&dev->settings));
+	if (chipId == BME280_CHIP_ID && calibOk) saveCache(dev, chipId);
+	return false;
 }
 
-//set PowerMode
-void setMode(int fd, uint8_t mode) {
-	uint8_t m;
-	if (readRegister(fd, BME280_PWR_CTRL_ADDR, &m, 1) != 1) {
-		printf("setMode() read BME280_PWR_CTRL_ADDR register error");
-		return;
+//creates the shared memory segment "bme280 --daemon" publishes samples of dev to
+struct Shm * openShm(const struct Device * dev, uint32_t interval_us) {
+	char name[64];
+	getShmName(dev->bus, dev->addr, name, sizeof(name));
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		perror("shm_open failed");
+		return NULL;
 	}
-	m = m & BME280_SENSOR_MODE_MSK;
-	if (m != BME280_SLEEP_MODE) {
-		//put dev to sleep
-		uint8_t regData[4];
-		struct Settings sets;
-		if (readRegister(fd, BME280_CTRL_HUM_ADDR, (uint8_t *)(&regData), 4) != 4) {
-			printf("setMode() read BME280_CTRL_HUM_ADDR register error");
-			return;
-		}
-		parseSettings(regData, &sets);
-		softReset(fd);
-		reloadSettings(fd, &sets);
+	if (ftruncate(fd, sizeof(struct Shm)) < 0) {
+		perror("ftruncate shm failed");
+		close(fd);
+		return NULL;
 	}
-	uint8_t regData, err;
-	if (readRegister(fd, BME280_PWR_CTRL_ADDR, (uint8_t *)&regData, 1) != 1) {
-		printf("setMode() read BME280_PWR_CTRL_ADDR register error");
-		return;
+	struct Shm * shm = mmap(NULL, sizeof(struct Shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		perror("mmap shm failed");
+		return NULL;
 	}
-	regData = (regData & (~BME280_SENSOR_MODE_MSK)) | (mode & BME280_SENSOR_MODE_MSK);
-	if ((err = writeRegister(fd, BME280_PWR_CTRL_ADDR, regData)) != 0)
-		printf("setMode() write BME280_PWR_CTRL_ADDR register error %hhd", err);
+	shm->magic = BME280_SHM_MAGIC;
+	shm->version = BME280_SHM_VERSION;
+	shm->pid = getpid();
+	shm->interval_ms = (interval_us + 999) / 1000;
+	return shm;
 }
 
-void parseData(uint8_t * regData, struct UncompData * data) {
-	data->p = ((uint32_t)regData[0] << 12) | ((uint32_t)regData[1] << 4) | ((uint32_t)regData[2] >> 4);
-	data->t = ((uint32_t)regData[3] << 12) | ((uint32_t)regData[4] << 4) | ((uint32_t)regData[5] >> 4);
-	data->h = ((uint32_t)regData[6] << 8) | (uint32_t)regData[7];
+void closeShm(const struct Device * dev, struct Shm * shm) {
+	char name[64];
+	getShmName(dev->bus, dev->addr, name, sizeof(name));
+	munmap(shm, sizeof(struct Shm));
+	shm_unlink(name);
+}
 
-	//printf("T = %ld, H = %lu, P = %lu\n", (int32_t)(data->t), data->h, data->p);
+void publishData(struct Shm * shm, const struct Data * data, const struct timespec * ts) {
+	struct ShmSample sample;
+	memset(&sample, 0, sizeof(sample));
+	sample.time_ns = (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+	sample.count = shm->sample.count + 1;
+	sample.p = data->p;
+	sample.t = data->t;
+	sample.h = data->h;
+	writeShm(shm, &sample);
 }
 
-int32_t compensateT(const struct UncompData * data, struct CalibData * calibData) {
-	int32_t t = 0, var1, var2, t_min = -4000, t_max = 8500;
-	var1 = ((((data->t >> 3) - ((int32_t)calibData->dig_T1 << 1))) * ((int32_t)calibData->dig_T2)) >> 11;
-	var2 = (((((data->t >> 4) - ((int32_t)calibData->dig_T1)) * ((data->t >> 4) - ((int32_t)calibData->dig_T1))) >> 12) * ((int32_t)calibData->dig_T3)) >> 14;
-	calibData->t_fine = var1 + var2;
-	t = (calibData->t_fine * 5 + 128) >> 8;
-	if (t < t_min) t = t_min;
-	else if (t > t_max) t = t_max;
+//opens or creates the binary log, an existing log is appended to if it has the same capacity
+struct LogHeader * openLog(const char * path, uint64_t capacity) {
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("Unable to open log");
+		return NULL;
+	}
+	struct stat st;
+	uint64_t size = getLogFileSize(capacity);
+	fstat(fd, &st);
+	bool create = st.st_size == 0;
+	if (!create && (uint64_t)st.st_size != size) {
+		printf("error: log %s has a different size, it was created with another --log-records\n", path);
+		close(fd);
+		return NULL;
+	}
+	//preallocate, so appending never fails with SIGBUS on a full disk
+	if (create && (errno = posix_fallocate(fd, 0, size)) != 0) {
+		perror("Unable to preallocate log");
+		close(fd);
+		return NULL;
+	}
+	struct LogHeader * log = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (log == MAP_FAILED) {
+		perror("mmap log failed");
+		return NULL;
+	}
+	if (create) {
+		log->version = BME280_LOG_VERSION;
+		log->record_size = sizeof(struct LogRecord);
+		log->index_stride = BME280_LOG_INDEX_STRIDE;
+		log->capacity = capacity;
+		atomic_store(&log->count, 0);
+		log->magic = BME280_LOG_MAGIC;
+	} else if (log->magic != BME280_LOG_MAGIC || log->version != BME280_LOG_VERSION || log->record_size != sizeof(struct LogRecord) || log->capacity != capacity) {
+		printf("error: %s is not a bme280 version %d log\n", path, BME280_LOG_VERSION);
+		munmap(log, size);
+		return NULL;
+	}
+	return log;
+}
 
-	//printf("compensateT: var1 = %ld, var2 = %ld, t = %ld\n", var1, var2, t);
+void closeLog(struct LogHeader * log) {
+	uint64_t size = getLogFileSize(log->capacity);
+	msync(log, size, MS_ASYNC);
+	munmap(log, size);
+}
 
-	return t; // t x 10^2 deg C
+//N of /dev/i2c-N
+//the key of the sensor in a record, see BME280_LOG_* in bme280_log.h
+void setLogDevice(struct LogRecord * rec, const struct Device * dev) {
+	const char * spidev = strstr(dev->bus, "spidev");
+	unsigned bus = 0, cs = 0;
+	if (strcmp(dev->bus, BME280_EMU_DEVICE) == 0) {
+		rec->transport = BME280_LOG_EMU;
+		rec->bus = 0;
+		rec->addr = dev->addr;
+	} else if (strcmp(dev->bus, BME280_EMU_SPI_DEVICE) == 0) {
+		rec->transport = BME280_LOG_EMU_SPI;
+		rec->bus = 0;
+		rec->addr = 0;
+	} else if (spidev) {
+		sscanf(spidev, "spidev%u.%u", &bus, &cs);
+		rec->transport = BME280_LOG_SPI;
+		rec->bus = bus;
+		rec->addr = cs;
+	} else {
+		const char * p = dev->bus + strlen(dev->bus);
+		while (p > dev->bus && isdigit(p[-1])) p--;
+		rec->transport = BME280_LOG_I2C;
+		rec->bus = atoi(p);
+		rec->addr = dev->addr;
+	}
+	rec->reserved = 0;
 }
 
-uint32_t compensateH(const struct UncompData * data, const struct CalibData * calibData) {
-	int32_t h;
+//the raw sample is always logged, data is the sample or the filtered one, or with --window the average of a window
+//at its end_ns with raw values of 0
+void appendLog(struct LogHeader * log, const struct Device * dev, int64_t time_ns, const struct UncompData * raw, const struct Data * data) {
+	uint64_t n = atomic_load_explicit(&log->count, memory_order_relaxed);
+	struct LogRecord * rec = &getLogRecords(log)[n % log->capacity];
+	rec->time_ns = time_ns;
+	rec->raw_p = raw->p;
+	rec->raw_t = raw->t;
+	rec->raw_h = raw->h;
+	rec->p = data->p;
+	rec->t = data->t;
+	rec->h = data->h;
+	setLogDevice(rec, dev);
+	if (n % BME280_LOG_INDEX_STRIDE == 0)
+		getLogIndex(log)[(n / BME280_LOG_INDEX_STRIDE) % getLogIndexLen(log->capacity)] = rec->time_ns;
+	//readers see the record only after it is complete
+	atomic_store_explicit(&log->count, n + 1, memory_order_release);
+}
 
-	h = calibData->t_fine - ((int32_t)76800L);
-	h = (((((data->h << 14) - (((int32_t)calibData->dig_H4) << 20) - (((int32_t)calibData->dig_H5) * h)) + ((int32_t)16384L)) >> 15) * (((((((h * ((int32_t)calibData->dig_H6)) >> 10) * (((h * ((int32_t)calibData->dig_H3)) >> 11) + ((int32_t)32768L))) >> 10) + ((int32_t)2097152L)) * ((int32_t)calibData->dig_H2) + 8192) >> 14));
-	h = (h - (((((h >> 15) * (h >> 15)) >> 7) * ((int32_t)calibData->dig_H1)) >> 4));
-	h = h < 0 ? 0 : h;
-	h = h > 419430400L ? 419430400L : h;
+//what /metrics serves for one device, updated by the sampling loop after every sweep,
+//so a scrape reads memory only and never causes I2C traffic
+struct Metrics
+{
+	const struct Device * dev;
+	struct Shm cache; //latest good sample, seqlock protected
+	atomic_ullong reads;
+	atomic_ullong errors; //failed reads, the cached sample gets older meanwhile
+};
 
-	//printf("compensateH: h = %ld\n", h);
+//one metric family in Prometheus text format, value(m, &v) returns false to skip a device
+int renderMetric(char * buf, size_t len, struct Metrics * metrics, int n, const char * name, const char * type, const char * help,
+	bool (*value)(struct Metrics * m, double * v)) {
+	char bus[16];
+	double v;
+	int pos = snprintf(buf, len, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	for (int i = 0; i < n && pos < (int)len; i++) {
+		if (!value(&metrics[i], &v)) continue;
+		const char * b = strrchr(metrics[i].dev->bus, '/');
+		snprintf(bus, sizeof(bus), "%s", b ? b + 1 : metrics[i].dev->bus);
+		pos += snprintf(buf + pos, len - pos, "%s{bus=\"%s\",addr=\"%02x\"} %.10g\n", name, bus, metrics[i].dev->addr, v);
+	}
+	return pos < (int)len ? pos : (int)len;
+}
 
-	return (uint32_t)(h >> 12); //in Q22.10 format (22 integer and 10 fractional bits) %RH = %RF / 1024.0
+bool getMetricT(struct Metrics * m, double * v) {
+	struct ShmSample sample;
+	if (!readShm(&m->cache, &sample)) return false;
+	*v = sample.t / 100.0;
+	return true;
 }
 
-uint32_t compensateP(const struct UncompData * data, const struct CalibData * calibData) {
-	int64_t var1, var2, p;
+bool getMetricH(struct Metrics * m, double * v) {
+	struct ShmSample sample;
+	if (!readShm(&m->cache, &sample)) return false;
+	*v = sample.h / 1024.0;
+	return true;
+}
 
-	var1 = ((int64_t)calibData->t_fine) - 128000L;
-	var2 = var1 * var1 * (int64_t)calibData->dig_P6;
-	var2 = var2 + ((var1 * (int64_t)calibData->dig_P5) << 17);
-	var2 = var2 + (((int64_t)calibData->dig_P4) << 35);
-	var1 = ((var1 * var1 * (int64_t)calibData->dig_P3) >> 8) + ((var1 * (int64_t)calibData->dig_P2) << 12);
-	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calibData->dig_P1) >> 33;
+bool getMetricP(struct Metrics * m, double * v) {
+	struct ShmSample sample;
+	if (!readShm(&m->cache, &sample)) return false;
+	*v = sample.p / 256.0;
+	return true;
+}
 
-	if (var1 == 0) return 0;
-	p = 1048576L - (int32_t)(data->p);
-	p = (((p << 31) - var2) * 3125) / var1;
-	var1 = (((int64_t)calibData->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-	var2 = (((int64_t)calibData->dig_P8) * p) >> 19;
-	p = ((p + var1 + var2) >> 8) + (((int64_t)calibData->dig_P7) << 4);
+bool getMetricAge(struct Metrics * m, double * v) {
+	struct ShmSample sample;
+	struct timespec now;
+	if (!readShm(&m->cache, &sample)) return false;
+	clock_gettime(CLOCK_REALTIME, &now);
+	*v = ((int64_t)now.tv_sec * 1000000000 + now.tv_nsec - sample.time_ns) / 1e9;
+	return true;
+}
 
-	//printf("compensateP: var1 = %lld, var2 = %lld, p = %ld\n", var1, var2, (uint32_t)p);
+bool getMetricReads(struct Metrics * m, double * v) {
+	*v = atomic_load_explicit(&m->reads, memory_order_relaxed);
+	return true;
+}
 
-	return (uint32_t)p; // in Q24.8 format (24 integer and 8 fractional bits) in Pa; p = p / 256 Pa
+bool getMetricErrors(struct Metrics * m, double * v) {
+	*v = atomic_load_explicit(&m->errors, memory_order_relaxed);
+	return true;
 }
 
-void compensateData(uint8_t dataType, const struct UncompData * uncompData, struct Data * data, struct CalibData * calibData) {
-	if (dataType & (BME280_PRESS | BME280_TEMP | BME280_HUM)) data->t = compensateT(uncompData, calibData);
-	if (dataType & BME280_PRESS) data->p = compensateP(uncompData, calibData);
-	if (dataType & BME280_HUM) data->h = compensateH(uncompData, calibData);
+int metricsCount; //devices in the array passed to startHttp()
+
+//HttpHandler for --metrics
+int handleMetrics(const char * path, char * buf, size_t len, const char ** content_type, void * ctx) {
+	struct Metrics * metrics = ctx;
+	int pos = 0;
+	if (strcmp(path, "/metrics") != 0) return -1;
+	*content_type = "text/plain; version=0.0.4; charset=utf-8";
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_temperature_celsius", "gauge", "Temperature of the latest sample.", getMetricT);
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_humidity_percent", "gauge", "Relative humidity of the latest sample.", getMetricH);
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_pressure_pascals", "gauge", "Atmospheric pressure of the latest sample.", getMetricP);
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_sample_age_seconds", "gauge", "Time since the latest sample was read.", getMetricAge);
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_reads_total", "counter", "Sensor reads attempted.", getMetricReads);
+	pos += renderMetric(buf + pos, len - pos, metrics, metricsCount, "bme280_read_errors_total", "counter", "Sensor reads that failed.", getMetricErrors);
+	return pos;
 }
 
-void getData(int fd, uint8_t dataType, struct Data * data) {
-	uint8_t regData[BME280_P_T_H_DATA_LEN] = { 0 };
-	struct UncompData uncompData = { 0, 0, 0 };
-	if (readRegister(fd, BME280_DATA_ADDR, (uint8_t *)&regData, BME280_P_T_H_DATA_LEN) != BME280_P_T_H_DATA_LEN) {
-		printf("getData() readRegister error\n");
-		return;
-	}
-	parseData((uint8_t *)&regData, &uncompData);
-	compensateData(dataType, &uncompData, data, &calibData);
+volatile sig_atomic_t stop = 0;
+uint32_t intervalUs = DEFAULT_SAMPLING_RATE_SEC * 1000000;
+
+//wake-up accounting of the sampling loop, reported with --stats
+struct SamplingStats
+{
+	uint64_t samples;
+	uint64_t missed; //deadlines skipped because a sweep overran
+	uint64_t jitter[JITTER_BUCKETS];
+	uint32_t max_jitter_us;
+	struct timespec start;
+} stats;
+
+volatile sig_atomic_t dumpInstr = 0; //SIGUSR1 asks for bus transaction statistics
+volatile sig_atomic_t reloadProfiles = 0; //SIGHUP asks to re-read --config
+
+void onSignal(int sig) {
+	stop = 1;
 }
 
-void parseTempPresCalibData(uint8_t * data, struct CalibData * calibData) {
-	calibData->dig_T1 = ((uint16_t)data[1] << 8) | (uint16_t)data[0];
-	calibData->dig_T2 = ((int16_t)data[3] << 8) | (int16_t)data[2];
-	calibData->dig_T3 = ((int16_t)data[5] << 8) | (uint16_t)data[4];
-	calibData->dig_P1 = ((uint16_t)data[7] << 8) | (uint16_t)data[6];
-	calibData->dig_P2 = ((int16_t)data[9] << 8) | (uint16_t)data[8];
-	calibData->dig_P3 = ((int16_t)data[11] << 8) | (uint16_t)data[10];
-	calibData->dig_P4 = ((int16_t)data[13] << 8) | (uint16_t)data[12];
-	calibData->dig_P5 = ((int16_t)data[15] << 8) | (uint16_t)data[14];
-	calibData->dig_P6 = ((int16_t)data[17] << 8) | (uint16_t)data[16];
-	calibData->dig_P7 = ((int16_t)data[19] << 8) | (uint16_t)data[18];
-	calibData->dig_P8 = ((int16_t)data[21] << 8) | (uint16_t)data[20];
-	calibData->dig_P9 = ((int16_t)data[23] << 8) | (uint16_t)data[22];
-	calibData->dig_H1 = data[25];
+void onDump(int sig) {
+	dumpInstr = 1;
+}
 
-	//printf("t1 = %u, t2 = %d, t3 = %d\n", calibData->dig_T1, calibData->dig_T2, calibData->dig_T3);
-	//printf("p1 = %u, p2 = %d, p3 = %d, p4 = %d, p5 = %d, p6 = %d, p7 = %d, p8 = %d, p9 = %d\n", calibData->dig_P1, calibData->dig_P2, calibData->dig_P3, calibData->dig_P4, calibData->dig_P5, calibData->dig_P6, calibData->dig_P7, calibData->dig_P8, calibData->dig_P9);
+void onReload(int sig) {
+	reloadProfiles = 1;
 }
 
-void parseHumidCalibData(uint8_t * data, struct CalibData * calibData) {
-	calibData->dig_H2 = ((int16_t)data[1] << 8) | (int16_t)data[0];
-	calibData->dig_H3 = data[2];
-	calibData->dig_H4 = (((int16_t)((int8_t)data[3])) << 4) | (((int16_t)data[4]) & 0xF);
-	calibData->dig_H5 = (((int16_t)((int8_t)data[5])) << 4) | ((int16_t)(data[4] >> 4) & 0xF);
-	calibData->dig_H6 = (int8_t)data[6];
+//reads the latest sample into dev->data
+//if fresh is set and a conversion is running, waits for it to finish first
+void readDevice(struct Device * dev, bool fresh) {
+	//data registers are shadowed during a burst read, so a running conversion does not corrupt it,
+	//but waiting for the conversion to finish gives the freshest sample
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dev->dataReadyAt, NULL) == EINTR);
+	if (fresh) waitForStatus(dev, BME280_STATUS_MEASURING_MSK, getMeasurementTimeUs(&dev->settings));
+	dev->data.h = 0; dev->data.p = 0; dev->data.t = 0;
+	dev->ok = getData(dev, getDataType(&dev->settings), &dev->data);
+}
 
-	//printf("h1 = %u, h2 = %d, h3 = %u, h4 = %d, h5 = %d, h6 = %d\n", calibData->dig_H1, calibData->dig_H2, calibData->dig_H3, calibData->dig_H4, calibData->dig_H5, calibData->dig_H6);
+//starts a single measurement of a sleeping sensor with one register write
+//ctrl_meas is not read back as the sensor is known to be asleep with our settings, see applySettings()
+void startForced(struct Device * dev) {
+	int err;
+	uint8_t ctrl_meas = (dev->regs[2] & ~BME280_SENSOR_MODE_MSK) | BME280_FORCED_MODE;
+	dev->ok = dev->burst = false;
+	if ((err = writeRegister(dev, BME280_CTRL_MEAS_ADDR, ctrl_meas)) != 0)
+		printf("startForced() writeRegister error %d\n", err);
 }
 
-void getCalibData(int fd, struct CalibData * calibData) {
-	uint8_t cData[BME280_TEMP_PRESS_CALIB_DATA_LEN];
-	memset((uint8_t *)cData, 0, BME280_TEMP_PRESS_CALIB_DATA_LEN);
-	if (readRegister(fd, BME280_TEMP_PRESS_CALIB_DATA_ADDR, (uint8_t *)&cData, BME280_TEMP_PRESS_CALIB_DATA_LEN) != BME280_TEMP_PRESS_CALIB_DATA_LEN) {
-		printf("getCalibData() readRegister error\n");
+//waits for the measurement started by startForced() and reads it, the sensor is back asleep by then
+//started is when startForced() was called, the typical measurement time is slept before the status register is polled
+void finishForced(struct Device * dev, const struct timespec * started) {
+	struct timespec t = *started;
+	addUs(&t, getMeasurementTimeTypUs(&dev->settings));
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+	if (!waitForStatus(dev, BME280_STATUS_MEASURING_MSK, getMeasurementTimeUs(&dev->settings) - getMeasurementTimeTypUs(&dev->settings) + BME280_POLL_MAX_US)) {
+		printf("finishForced() waitForStatus timeout\n");
 		return;
 	}
-	parseTempPresCalibData(cData, calibData);
-	memset((uint8_t *)cData, 0, BME280_TEMP_PRESS_CALIB_DATA_LEN);
-	if (readRegister(fd, BME280_HUMIDITY_CALIB_DATA_ADDR, (uint8_t *)&cData, BME280_HUMIDITY_CALIB_DATA_LEN) != BME280_HUMIDITY_CALIB_DATA_LEN) {
-		printf("getCalibData() readRegister2 error\n");
-		return;
-	}
-	parseHumidCalibData(cData, calibData);
+	dev->data.h = 0; dev->data.p = 0; dev->data.t = 0;
+	dev->ok = getData(dev, getDataType(&dev->settings), &dev->data);
 }
 
-void printData(struct Data * data, bool raw) {
-	double t, p, h;
-	uint8_t deg[3] = { 0xc2, 0xb0, 0 }; //unicode degree symbol
-	t = data->t / 100.0;
-	p = data->p / 256.0;
-	h = data->h / 1024.0;
+//all devices on one bus are served by one worker thread, buses are sampled in parallel
+struct Bus
+{
+	const char * path;
+	struct Device * devs[MAX_DEVICES];
+	int n;
+	pthread_t thread;
+};
 
-	if (raw)
-		printf("t=%.1f&h=%.1f&p=%.1f\n", t, h, p / 100);
-	else 
-		printf("T = %.1f%sC, H = %.1f%%, P = %.1fmb(hPa) (%.1fmm Hg)\n", t, (char *)(&deg), h, p / 100, p * 0.0075006157584566);
+pthread_barrier_t sweepStart, sweepDone;
+volatile bool quit = false; //set by main thread only, before the last sweepStart
+bool reportProfiles = false; //print the profile of each device when it is applied
+bool capturing = false; //--capture, the calibration registers are kept as read
+
+//samples until the output shows 75% of a step change of the input, datasheet table 7
+uint8_t getFilterResponseSamples(uint8_t filter) {
+	static const uint8_t samples[5] = { 1, 2, 5, 11, 22 };
+	return samples[filter > BME280_FILTER_COEFF_16 ? BME280_FILTER_COEFF_16 : filter];
 }
 
-void setup(int fd) {
-	//Just to verify that we talk to the right device
-	getChipId(fd);
-	softReset(fd);
-	getCalibData(fd, &calibData);
-
-	//oversampling reduces noise and increases the resolution if filter is off. 
-	//Mostly the pressure is affected by enviromnental fluctuation and hence requires oversampling the most. Humidity is affected the least.
-	//if both oversampling and filter are off, the resolution is 16 bit. 
-	//if filter is on, the temperature and pressure resolution are 20 bits and humidity is 16 bit.
-	//if filter is off, the resolution increases by 1 bit for each oversampling step (1, 2, 4, 8, 16) minus 1:
-	//for example, with 1X oversampling, it is still 16 bits, with 2X - it is 17 bits and with 16X - it is 20.
-	settings.osr_h = BME280_OVERSAMPLING_16X;
-	settings.osr_t = BME280_OVERSAMPLING_16X;
-	settings.osr_p = BME280_OVERSAMPLING_16X;
-
-	//IIR low pass filter effectively reduces the bandwidth of temperature and pressure output signals and increases the resolution of those signals to 20 bits
-	//IIR formula: data = (old_data * (filter_coeff - 1) + new_data) / filter_coeff
-	//the higher the coefficient, the slower the sensor response as it takes more samples
-	//with coeff = 2, it takes 8 samples to fully measure the environmental change; with coeff = 4 - 18 , with coeff = 8, more than 32, a and with coeff = 16, even much more samples
-	settings.filter = BME280_FILTER_COEFF_16;
-	settings.standby_time = BME280_STANDBY_TIME_10_MS;
-	uint8_t settings_sel = BME280_OSR_PRESS_SEL | BME280_OSR_TEMP_SEL | BME280_OSR_HUM_SEL | BME280_FILTER_SEL | BME280_STANDBY_SEL;
-	setSettings(fd, settings_sel);
-	//there are three modes: SLEEP, FORCED and NORMAL
-	//in SLEEP_MODE all registers are accessible but no measurements are done; hence, the power consumption is minimum
-	//in FORCED_MODE a single measurement is done in accordance with the selected measurements and filter options, then the sensor enters the SLEEP_MODE
-	//for the next measurement the FORCED_MODE needs to be selected again
-	//in NORMAL_MODE the sensor cycling between active and standby periods. The standby_time can be selected between 0.5 and 1000ms
-	//in NORMAL_MODE data is always accessible without the need for further write accesses
-	//NORMAL_MODE is recommended when using IIR filter to filter short-term environmental disturbances
-	setMode(fd, BME280_NORMAL_MODE);
+//settings, conversion time, highest output data rate and filter response of a profile, for --list-profiles and when applied
+void printProfile(FILE * f, const char * name, const struct Profile * profile) {
+	static const char * filters[5] = { "off", "2", "4", "8", "16" };
+	static const char * standby[8] = { "0.5", "62.5", "125", "250", "500", "1000", "10", "20" };
+	const struct Settings * s = &profile->settings;
+	char sb[32] = "";
+	if (profile->mode != BME280_FORCED_MODE) snprintf(sb, sizeof(sb), ", standby %s ms", standby[s->standby_time & 7]);
+	//a forced measurement can be started as soon as the previous one has finished
+	uint32_t standbyUs = profile->mode == BME280_FORCED_MODE ? 0 : getStandbyTimeUs(s->standby_time);
+	uint32_t typ = getMeasurementTimeTypUs(s) + standbyUs, max = getMeasurementTimeUs(s) + standbyUs;
+	uint8_t samples = getFilterResponseSamples(s->filter);
+	fprintf(f, "%s: ", name);
+	if (strcmp(name, profile->name) != 0) fprintf(f, "%s, ", profile->name);
+	fprintf(f, "%s mode, oversampling t %ux p %ux h %ux, filter %s%s, measurement %.2f ms typ %.2f ms max, output rate %.1f Hz typ %.1f Hz min, 75%% step response %u samples (%.1f ms)\n",
+		profile->mode == BME280_FORCED_MODE ? "forced" : "normal", getOversampling(s->osr_t), getOversampling(s->osr_p), getOversampling(s->osr_h),
+		filters[s->filter > BME280_FILTER_COEFF_16 ? BME280_FILTER_COEFF_16 : s->filter], sb, getMeasurementTimeTypUs(s) / 1e3, getMeasurementTimeUs(s) / 1e3,
+		1e6 / typ, 1e6 / max, samples, samples * max / 1e3);
 }
 
-void loop(int fd, int sampling_rate_sec, bool raw) {
-	sleep(sampling_rate_sec);
-	struct Data data;
-	data.h = 0; data.p = 0; data.t = 0;
-	getData(fd, BME280_ALL, &data);
-	printData(&data, raw);
+void * busWorker(void * arg) {
+	struct Bus * bus = arg;
+	int i;
+	char name[32];
+	for (i = 0; i < bus->n; i++) {
+		setup(bus->devs[i]);
+		if (capturing) bus->devs[i]->calibRead = getCalibRegs(bus->devs[i], bus->devs[i]->calib);
+		if (reportProfiles) printProfile(stderr, getDeviceName(bus->devs[i], name, sizeof(name)), &bus->devs[i]->profile);
+		uint32_t period = getOutputPeriodUs(&bus->devs[i]->settings);
+		if (bus->devs[i]->mode != BME280_FORCED_MODE && intervalUs < period)
+			fprintf(stderr, "warning: %s produces a new sample every %u us, faster sampling repeats samples\n", getDeviceName(bus->devs[i], name, sizeof(name)), period);
+	}
+	while (true) {
+		pthread_barrier_wait(&sweepStart);
+		if (quit) break;
+		//profiles changed by the main thread before sweepStart
+		for (i = 0; i < bus->n; i++) {
+			struct Device * dev = bus->devs[i];
+			if (capturing && !dev->calibRead) dev->calibRead = getCalibRegs(dev, dev->calib);
+			if (!dev->reload) continue;
+			dev->reload = false;
+			if (reconfigure(dev, &dev->profile.settings, dev->profile.mode)) printProfile(stderr, getDeviceName(dev, name, sizeof(name)), &dev->profile);
+		}
+		//forced measurements of all devices on the bus run at the same time
+		struct timespec started;
+		clock_gettime(CLOCK_MONOTONIC, &started);
+		for (i = 0; i < bus->n; i++)
+			if (bus->devs[i]->mode == BME280_FORCED_MODE) startForced(bus->devs[i]);
+		//with several devices on the bus or when sampling faster than the sensor converts,
+		//read back-to-back instead of waiting for each conversion
+		for (i = 0; i < bus->n; i++) {
+			if (bus->devs[i]->mode == BME280_FORCED_MODE) finishForced(bus->devs[i], &started);
+			else readDevice(bus->devs[i], bus->n == 1 && intervalUs >= getOutputPeriodUs(&bus->devs[i]->settings));
+		}
+		pthread_barrier_wait(&sweepDone);
+	}
+	return NULL;
 }
 
-void i2c_funcs(int fd) {
+//returns the functionality mask of the i2c adapter, 0 if it cannot be read, and prints it if print is set
+ulong i2c_funcs(int fd, bool print) {
 	int res;
 	ulong funcs;
 	bool i2c, addr10bit, prot_mangling, smbus_pec,
@@ -489,8 +958,9 @@ void i2c_funcs(int fd) {
 	res = ioctl(fd, I2C_FUNCS, &funcs);
 	if (res < 0) {
 		perror("getting i2c functionality mask failed");
-		return;
+		return 0;
 	}
+	if (!print) return funcs;
 
 	i2c = I2C_FUNC_I2C & funcs ? true : false;
 	addr10bit = I2C_FUNC_10BIT_ADDR & funcs ? true : false;
@@ -517,69 +987,1371 @@ void i2c_funcs(int fd) {
 		quick, read_byte, write_byte, read_byte_data, write_byte_data,
 		read_word_data, write_word_data, proc_call, read_block_data, write_block_data,
 		read_i2c_block, write_i2c_block, host_notify);
+	return funcs;
+}
+
+//selects the fastest register read method supported by an i2c adapter with functionality mask funcs
+uint8_t getI2cXfer(ulong funcs) {
+	if (funcs & I2C_FUNC_I2C) return I2C_XFER_RDWR;
+	if (funcs & I2C_FUNC_SMBUS_READ_I2C_BLOCK) return I2C_XFER_SMBUS_BLOCK;
+	return I2C_XFER_SMBUS_BYTE;
+}
+
+const char * emuOptions = NULL; //--emu
+uint32_t spiSpeedHz = SPI_DEFAULT_SPEED_HZ; //--spi-speed
+
+//transport state of an emu-spi device
+struct SpiEmu
+{
+	struct Spi spi;
+	struct Emu emu;
+};
+
+//device "emu" is a software sensor, see bme280_emu.h
+bool openEmu(struct Device * dev) {
+	struct Emu * emu = malloc(sizeof(struct Emu));
+	initEmu(emu, NULL);
+	if (emuOptions && !parseEmu(emu, emuOptions)) {
+		printf("error: invalid --emu options %s\n", emuOptions);
+		free(emu);
+		return false;
+	}
+	dev->fd = -1;
+	dev->transport = &emuTransport;
+	dev->priv = emu;
+	dev->xfer = I2C_XFER_RDWR;
+	return true;
+}
+
+//spidev or, for emu-spi, the software sensor on the other end of SPI transfers
+bool openSpiDevice(struct Device * dev) {
+	bool emu = strcmp(dev->bus, BME280_EMU_SPI_DEVICE) == 0;
+	struct SpiEmu * se = malloc(sizeof(struct SpiEmu));
+	if (emu) {
+		initEmu(&se->emu, NULL);
+		if (emuOptions && !parseEmu(&se->emu, emuOptions)) {
+			printf("error: invalid --emu options %s\n", emuOptions);
+			free(se);
+			return false;
+		}
+	}
+	if (!openSpi(&se->spi, dev->bus, spiSpeedHz, emu ? &se->emu : NULL)) {
+		free(se);
+		return false;
+	}
+	dev->fd = se->spi.fd;
+	dev->transport = &spiTransport;
+	dev->priv = se;
+	dev->xfer = SPI_XFER;
+	return true;
+}
+
+bool isSpiDevice(const char * bus) {
+	return strcmp(bus, BME280_EMU_SPI_DEVICE) == 0 || strstr(bus, "spidev") != NULL;
+}
+
+//each device gets its own file descriptor, so its slave address is set once
+bool openDevice(struct Device * dev) {
+	if (strcmp(dev->bus, BME280_EMU_DEVICE) == 0) return openEmu(dev);
+	if (isSpiDevice(dev->bus)) return openSpiDevice(dev);
+	dev->fd = open(dev->bus, O_RDWR);
+	//printf("fd %d\n", fd);
+	if (dev->fd < 0) {
+		perror("Unable to open i2c device");
+		return false;
+	}
+	if (ioctl(dev->fd, I2C_RETRIES, I2C_DEV_RETRIES) < 0) {
+		perror("setting number of retries failed");
+		return false;
+	}
+	if (ioctl(dev->fd, I2C_TIMEOUT, I2C_TIMEOUT) < 0) {
+		perror("setting timeout failed");
+		return false;
+	}
+	if (ioctl(dev->fd, I2C_SLAVE, dev->addr) < 0) {
+		perror("setting slave address failed");
+		return false;
+	}
+	
+	dev->xfer = getI2cXfer(i2c_funcs(dev->fd, false));
+	return true;
+}
+
+//parses <i2c-dev>[:addr] or <spidev>, addr is hex and defaults to BME280_I2C_ADDR_PRIM, which SPI devices keep for profiles and the cache
+bool parseDevice(const char * arg, struct Device * dev) {
+	const char * colon = strchr(arg, ':');
+	size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+	if (len >= sizeof(dev->bus)) {
+		printf("error: i2c-dev string \'%s\' is too long, must be less than %zu chars\n", arg, sizeof(dev->bus));
+		return false;
+	}
+	memset(dev, 0, sizeof(struct Device));
+	dev->transport = &i2cTransport;
+	memcpy(dev->bus, arg, len);
+	dev->addr = BME280_I2C_ADDR_PRIM;
+	if (colon && isSpiDevice(dev->bus)) {
+		printf("error: %s is an SPI device, it has no address\n", arg);
+		return false;
+	}
+	if (colon) {
+		char * end;
+		dev->addr = strtoul(colon + 1, &end, 16);
+		if (*end || (dev->addr != BME280_I2C_ADDR_PRIM && dev->addr != BME280_I2C_ADDR_SEC)) {
+			printf("error: address %s must be %x or %x\n", colon + 1, BME280_I2C_ADDR_PRIM, BME280_I2C_ADDR_SEC);
+			return false;
+		}
+	}
+	return true;
+}
+
+//profile of dev from the profile file if it lists dev, otherwise the one given with --profile
+bool getProfile(const struct Device * dev, const char * configPath, const struct Profile * profile, struct Profile * devProfile) {
+	int found = configPath ? loadProfile(configPath, dev->bus, dev->addr, devProfile) : 0;
+	if (found == 0) *devProfile = *profile;
+	return found >= 0;
+}
+
+//parses sampling interval: seconds (1, 0.5), milliseconds (250ms) or frequency (10hz)
+bool parseInterval(const char * arg, uint32_t * interval_us) {
+	char * end;
+	double v = strtod(arg, &end);
+	if (end == arg || v <= 0) return false;
+	if (strcasecmp(end, "ms") == 0) v *= 1000;
+	else if (strcasecmp(end, "hz") == 0) v = 1000000 / v;
+	else if (*end == 0 || strcasecmp(end, "s") == 0) v *= 1000000;
+	else return false;
+	if (v < 1 || v > UINT32_MAX) return false;
+	*interval_us = v;
+	return true;
+}
+
+//comma separated print, log, push, shm, metrics, window and stream to OUTPUT_* bits
+bool parseOutputs(const char * arg, uint8_t * outputs) {
+	static const char * names[] = { "print", "log", "push", "shm", "metrics", "window", "stream" };
+	const char * p = arg;
+	*outputs = 0;
+	while (*p) {
+		size_t len = strcspn(p, ",");
+		int i;
+		for (i = 0; i < 7 && (strlen(names[i]) != len || strncmp(p, names[i], len) != 0); i++);
+		if (i == 7) return false;
+		*outputs |= 1 << i;
+		p += len;
+		if (*p) p++;
+	}
+	return *outputs != 0;
+}
+
+//the sample an output gets, filtered is the --filtered outputs, 0 without --filter
+const struct Data * getOutputData(const struct OutputSample * s, uint8_t filtered, uint8_t output) {
+	return filtered & output ? &s->filtered : &s->data;
+}
+
+//outputs that may block run on their own thread, fed by the sampling loop through a ring,
+//so a slow stdout reader, a full pipe or a stalled disk do not delay sensor reads
+struct Writer
+{
+	struct Ring ring;
+	pthread_t thread;
+	struct Device * devs;
+	int ndevs;
+	struct LogHeader * log;
+	bool push;
+	bool print; //samples or windows go to stdout
+	bool raw; //--raw
+	struct Window * windows; //with --window
+	uint8_t filtered; //--filtered outputs
+	struct Capture * capture; //with --capture
+	bool captured[MAX_DEVICES]; //device record written
+	uint8_t capturedRegs[MAX_DEVICES][4]; //settings in the last device record
+	const struct Deadband * deadband; //with --deadband or --heartbeat
+	struct DeadbandState gates[MAX_DEVICES][2]; //for the samples as read and the filtered ones
+	atomic_ullong passed, suppressed; //samples the deadband let through and held back
+	FILE * stream; //with --stream
+	struct StreamState streamState;
+};
+
+//a device record precedes the first sample of a device and any sample measured with other settings,
+//samples taken before its calibration registers could be read are left out, replay would compensate them with zeros
+void captureSample(struct Writer * w, const struct OutputSample * s) {
+	struct Device * dev = &w->devs[s->dev];
+	if (!s->calibRead) return;
+	if (!w->captured[s->dev] || memcmp(w->capturedRegs[s->dev], s->regs, sizeof(s->regs)) != 0) {
+		struct CaptureDevice cd;
+		memset(&cd, 0, sizeof(cd));
+		cd.id = s->dev;
+		snprintf(cd.bus, sizeof(cd.bus), "%s", dev->bus);
+		cd.addr = dev->addr;
+		memcpy(cd.regs, s->regs, sizeof(cd.regs));
+		memcpy(cd.calib, dev->calib, sizeof(cd.calib));
+		if (!writeCaptureDevice(w->capture, &cd)) perror("Unable to write capture");
+		w->captured[s->dev] = true;
+		memcpy(w->capturedRegs[s->dev], s->regs, sizeof(s->regs));
+	}
+	if (!writeCaptureSample(w->capture, s->dev, s->time_ns, s->regData)) perror("Unable to write capture");
+}
+
+//with --window stdout, the log and the push exporter get a closed window instead of samples
+void writeWindow(struct Writer * w, struct Device * dev, const char * prefix, const struct WindowData * agg) {
+	static const struct UncompData none = { 0, 0, 0 };
+	if (w->print) printWindow(prefix, agg, w->raw);
+	if (w->log) appendLog(w->log, dev, agg->end_ns, &none, &agg->avg);
+	if (w->push) pushAggregate(dev->bus, dev->addr, agg);
+}
+
+void writeSample(struct Writer * w, const struct OutputSample * s) {
+	struct Device * dev = &w->devs[s->dev];
+	struct WindowData agg;
+	char name[32];
+	const char * prefix = w->ndevs > 1 ? getDeviceName(dev, name, sizeof(name)) : NULL;
+	if (w->capture) captureSample(w, s);
+	if (!s->ok) return;
+	//windows aggregate every sample, the deadband only gates what is output sample by sample
+	if (w->windows) {
+		while (popWindow(&w->windows[s->dev], s->time_ns, &agg)) writeWindow(w, dev, prefix, &agg);
+		pushWindow(&w->windows[s->dev], s->time_ns, getOutputData(s, w->filtered, OUTPUT_WINDOW));
+	}
+	//an output is gated on the samples it gets, so with --filtered log the log follows the filtered samples,
+	//and print, getting them as read, follows the raw ones
+	uint8_t outputs = (w->stream ? OUTPUT_STREAM : 0) |
+		(w->windows ? 0 : (w->print ? OUTPUT_PRINT : 0) | (w->log ? OUTPUT_LOG : 0) | (w->push ? OUTPUT_PUSH : 0));
+	bool pass[2] = { true, true }; //indexed by whether the output gets filtered samples
+	if (w->deadband && outputs) {
+		struct Settings sets;
+		parseSettings(s->regs, &sets);
+		for (int f = 0; f < 2; f++)
+			if (outputs & (f ? w->filtered : ~w->filtered))
+				pass[f] = passDeadband(w->deadband, &w->gates[s->dev][f], getDataType(&sets), s->time_ns, f ? &s->filtered : &s->data);
+			else
+				pass[f] = false;
+		if (!pass[0] && !pass[1]) {
+			atomic_fetch_add_explicit(&w->suppressed, 1, memory_order_relaxed);
+			return;
+		}
+		atomic_fetch_add_explicit(&w->passed, 1, memory_order_relaxed);
+	}
+	if (w->log && !w->windows && pass[(w->filtered & OUTPUT_LOG) != 0])
+		appendLog(w->log, dev, s->time_ns, &s->raw, getOutputData(s, w->filtered, OUTPUT_LOG));
+	if (w->push && !w->windows && pass[(w->filtered & OUTPUT_PUSH) != 0])
+		pushSample(dev->bus, dev->addr, getOutputData(s, w->filtered, OUTPUT_PUSH), s->time_ns);
+	if (w->stream && pass[(w->filtered & OUTPUT_STREAM) != 0]) {
+		const struct Data * data = getOutputData(s, w->filtered, OUTPUT_STREAM);
+		struct StreamSample ss = { s->time_ns, data->p, data->t, data->h };
+		if (!writeStreamSample(w->stream, &w->streamState, s->dev, prefix ? prefix : getDeviceName(dev, name, sizeof(name)), &ss)) perror("Unable to write stream");
+	}
+	if (!w->windows && w->print && pass[(w->filtered & OUTPUT_PRINT) != 0]) printData(prefix, getOutputData(s, w->filtered, OUTPUT_PRINT), w->raw);
+}
+
+//drains the ring in batches and flushes stdout once per batch
+void * writerWorker(void * arg) {
+	struct Writer * w = arg;
+	struct OutputSample s;
+	while (waitRing(&w->ring)) {
+		for (int n = 0; n < WRITER_BATCH && popRing(&w->ring, &s); n++) writeSample(w, &s);
+		fflush(stdout);
+		if (w->capture) fflush(w->capture->f);
+		if (w->stream) fflush(w->stream);
+	}
+	return NULL;
+}
+
+void printWriterStats(struct Writer * w) {
+	struct Ring * r = &w->ring;
+	fprintf(stderr, "output queue: capacity %u, %s, queued %llu, dropped %llu, blocked %llu, high water %u\n",
+		r->cap, getBackpressureName(r->policy), (unsigned long long)atomic_load(&r->pushed), (unsigned long long)atomic_load(&r->dropped),
+		(unsigned long long)atomic_load(&r->blocked), atomic_load(&r->highWater));
+	if (w->deadband) fprintf(stderr, "deadband: passed %llu, suppressed %llu\n", (unsigned long long)atomic_load(&w->passed), (unsigned long long)atomic_load(&w->suppressed));
+	fflush(stderr);
+}
+
+int64_t diffUs(const struct timespec * a, const struct timespec * b) {
+	return (int64_t)(a->tv_sec - b->tv_sec) * 1000000 + (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+void recordJitter(uint32_t late_us) {
+	int i = 0;
+	while (i < JITTER_BUCKETS - 1 && (late_us >> i) != 0) i++;
+	stats.jitter[i]++;
+	if (late_us > stats.max_jitter_us) stats.max_jitter_us = late_us;
+}
+
+void printStats() {
+	struct timespec now;
+	int i;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = diffUs(&now, &stats.start) / 1e6;
+	fprintf(stderr, "samples %llu in %.3f s, rate %.3f Hz (target %.3f Hz), missed deadlines %llu, max jitter %u us\n",
+		(unsigned long long)stats.samples, elapsed, elapsed > 0 ? stats.samples / elapsed : 0, 1e6 / intervalUs,
+		(unsigned long long)stats.missed, stats.max_jitter_us);
+	fprintf(stderr, "jitter histogram:\n");
+	for (i = 0; i < JITTER_BUCKETS; i++) {
+		if (stats.jitter[i] == 0) continue;
+		if (i == 0) fprintf(stderr, "  < 1 us: %llu\n", (unsigned long long)stats.jitter[i]);
+		else if (i == JITTER_BUCKETS - 1) fprintf(stderr, "  >= %u us: %llu\n", 1u << (i - 1), (unsigned long long)stats.jitter[i]);
+		else fprintf(stderr, "  %u - %u us: %llu\n", 1u << (i - 1), (1u << i) - 1, (unsigned long long)stats.jitter[i]);
+	}
+}
+
+//bus transaction statistics of all devices, on SIGUSR1 and with --stats at exit
+void printDevicesInstr(struct Device * devs, int n) {
+	char name[32];
+	for (int i = 0; i < n; i++) printInstr(stderr, getDeviceName(&devs[i], name, sizeof(name)), &devs[i].instr);
+	fflush(stderr);
+}
+
+//calibration sets the benchmarks run against, compensation cost does not depend on them
+//but the pressure division and clamping paths do on the data they produce
+struct BenchCalib
+{
+	const char * name;
+	struct CalibData calibData;
+} benchCalibs[] = {
+	{ "datasheet", { 27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, 75, 370, 0, 313, 50, 30 } },
+	{ "typical", { 28485, 26735, 50, 37165, -10681, 3024, 6937, -107, -7, 9900, -10230, 4285, 75, 353, 0, 340, 0, 30 } },
+	{ "extreme", { 65535, 32767, -32768, 65535, -32768, 32767, -32768, 32767, -32768, 32767, -32768, 32767, 255, 32767, 255, 2047, -2048, -128 } },
+};
+
+//raw samples around 25 deg C, 1000 hPa and 50 %RH with some noise
+void fillBenchData(struct UncompData * data, size_t n) {
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i].t = 519888 + (seed >> 8) % 20000 - 10000;
+		data[i].p = 415148 + (seed >> 12) % 40000 - 20000;
+		data[i].h = 27000 + (seed >> 16) % 8000 - 4000;
+	}
+}
+
+volatile uint32_t benchSink; //keeps results of benchmarked code alive
+
+//one JSON object per line, ops is the number of operations timed in ns
+void printBench(const char * bench, const char * op, const char * calib, const char * impl, uint64_t ops, uint64_t ns) {
+	printf("{\"bench\":\"%s\",\"op\":\"%s\",\"calib\":\"%s\",\"impl\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f}\n",
+		bench, op, calib, impl, (unsigned long long)ops, (double)ns / ops, ops * 1e9 / ns);
+}
+
+void benchKernels(const struct BenchCalib * bc, const struct UncompData * raw, size_t n) {
+	static uint32_t raw_t[BENCH_SAMPLES], raw_p[BENCH_SAMPLES], raw_h[BENCH_SAMPLES], p[BENCH_SAMPLES], h[BENCH_SAMPLES];
+	static int32_t t[BENCH_SAMPLES], t_fine[BENCH_SAMPLES];
+	const struct CalibData * calib = &bc->calibData;
+	const char * ops[] = { "compensateT", "compensateP", "compensateH", "compensateData" };
+	uint64_t count, start, ns;
+	size_t i;
+	struct Data data = { 0, 0, 0 }; //channels a reduced core leaves out stay 0
+
+	//t_fine of every sample, so P and H are timed on their own
+	for (i = 0; i < n; i++) {
+		raw_t[i] = raw[i].t;
+		raw_p[i] = raw[i].p;
+		raw_h[i] = raw[i].h;
+		compensateT(&raw[i], calib, &t_fine[i]);
+	}
+	for (int op = 0; op < 4; op++) {
+		uint32_t sink = 0;
+		int32_t tf;
+		count = 0;
+		start = nowNs();
+		do {
+			for (i = 0; i < n; i++) {
+				switch (op) {
+				case 0: sink += compensateT(&raw[i], calib, &tf); break;
+				case 1: sink += compensateP(&raw[i], calib, t_fine[i]); break;
+				case 2: sink += compensateH(&raw[i], calib, t_fine[i]); break;
+				default:
+					compensateData(BME280_ALL, &raw[i], &data, calib);
+					sink += data.p + data.h;
+				}
+			}
+			count += n;
+		} while ((ns = nowNs() - start) < BENCH_MIN_NS);
+		benchSink = sink;
+		printBench("kernel", ops[op], bc->name, "single", count, ns);
+	}
+
+	//batch API, once per available implementation
+	const int impls[] = { BATCH_IMPL_SCALAR, BATCH_IMPL_AVX2, BATCH_IMPL_NEON };
+	const char * batchOps[] = { "compensateBatchT", "compensateBatchP", "compensateBatchH", "compensateBatch" };
+	for (int k = 0; k < 3; k++) {
+		if (!setBatchImpl(impls[k])) continue;
+		for (int op = 0; op < 4; op++) {
+			count = 0;
+			start = nowNs();
+			do {
+				switch (op) {
+				case 0: compensateBatchT(calib, raw_t, t, t_fine, n); break;
+				case 1: compensateBatchP(calib, raw_p, t_fine, p, n); break;
+				case 2: compensateBatchH(calib, raw_h, t_fine, h, n); break;
+				default: compensateBatch(calib, raw_t, raw_p, raw_h, t, p, h, t_fine, n);
+				}
+				count += n;
+			} while ((ns = nowNs() - start) < BENCH_MIN_NS);
+			benchSink = t[n - 1] + p[n - 1] + h[n - 1];
+			printBench("kernel", batchOps[op], bc->name, getBatchImpl(), count, ns);
+		}
+	}
+	setBatchImpl(BATCH_IMPL_AUTO);
+}
+
+//data register bytes to an output line, as done for every sample
+void benchPipeline(const struct BenchCalib * bc, const struct UncompData * raw, size_t n) {
+	static uint8_t regData[BENCH_SAMPLES][BME280_P_T_H_DATA_LEN];
+	struct UncompData uncompData;
+	struct Data data;
+	char line[128];
+	uint64_t count, start, ns;
+	size_t i;
+
+	for (i = 0; i < n; i++) encodeData(&raw[i], regData[i]);
+	for (int fmt = 0; fmt < 2; fmt++) {
+		uint32_t sink = 0;
+		count = 0;
+		start = nowNs();
+		do {
+			for (i = 0; i < n; i++) {
+				parseData(regData[i], &uncompData);
+				compensateData(BME280_ALL, &uncompData, &data, &bc->calibData);
+				sink += formatData(line, sizeof(line), NULL, &data, fmt);
+			}
+			count += n;
+		} while ((ns = nowNs() - start) < BENCH_MIN_NS);
+		benchSink = sink;
+		printBench("pipeline", fmt ? "parse+compensate+format raw" : "parse+compensate+format", bc->name, "single", count, ns);
+	}
+}
+
+//bus transactions and time per setup() and getData() of the default profile against the emulator, over each I2C read method and SPI,
+//setup() is measured without the cache (cold, after a power cycle) and with it (warm, a later run),
+//reconfigure() alternates a running sensor between its settings and 1x oversampling without filter
+void benchIo(const struct BenchCalib * bc) {
+	const char * xfers[] = { "rdwr", "smbus-block", "smbus-byte", "spi" };
+	const char * ops[] = { "setup cold", "setup warm", "getData", "reconfigure" };
+	struct Settings sets[2];
+	struct Device dev;
+	struct Emu emu;
+	struct Spi spi;
+	struct Data data;
+	char dir[] = "/tmp/bme280-bench-XXXXXX", path[64];
+	uint64_t count, start, ns;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp failed");
+		return;
+	}
+	openSpi(&spi, BME280_EMU_SPI_DEVICE, SPI_DEFAULT_SPEED_HZ, &emu);
+	for (uint8_t xfer = I2C_XFER_RDWR; xfer <= SPI_XFER; xfer++) {
+		for (int op = 0; op < 4; op++) {
+			initEmu(&emu, &bc->calibData);
+			memset(&dev, 0, sizeof(dev));
+			strcpy(dev.bus, "/dev/i2c-bench");
+			dev.addr = BME280_I2C_ADDR_PRIM;
+			dev.transport = xfer == SPI_XFER ? &spiTransport : &emuTransport;
+			dev.priv = xfer == SPI_XFER ? (void *)&spi : &emu;
+			dev.xfer = xfer;
+			dev.settings = presets[0].settings;
+			dev.mode = presets[0].mode;
+			cacheDir = op == 0 ? NULL : dir;
+			if (op > 0) setup(&dev);
+			//getData() before the first conversion would only read the reset values, time real samples
+			if (op == 2) while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dev.dataReadyAt, NULL) == EINTR);
+			sets[0] = dev.settings;
+			sets[1] = (struct Settings){ BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_FILTER_COEFF_OFF, dev.settings.standby_time };
+			emu.reads = emu.writes = emu.bytes = 0;
+			count = 0;
+			start = nowNs();
+			do {
+				if (op < 2) setup(&dev);
+				else if (op == 2) getData(&dev, BME280_ALL, &data);
+				else reconfigure(&dev, &sets[(count + 1) & 1], dev.mode);
+				count++;
+			} while ((ns = nowNs() - start) < BENCH_MIN_NS);
+			printf("{\"bench\":\"io\",\"op\":\"%s\",\"calib\":\"%s\",\"xfer\":\"%s\",\"ops\":%llu,\"reads_per_op\":%.2f,\"writes_per_op\":%.2f,\"bytes_per_op\":%.2f,\"ns_per_op\":%.2f}\n",
+				ops[op], bc->name, xfers[xfer], (unsigned long long)count, (double)emu.reads / count, (double)emu.writes / count, (double)emu.bytes / count, (double)ns / count);
+		}
+	}
+	getCachePath(&dev, path, sizeof(path));
+	unlink(path);
+	rmdir(dir);
+	cacheDir = BME280_CACHE_DIR;
+}
+
+//runs all benchmarks without a sensor and prints one JSON object per result line
+void bench() {
+	static struct UncompData raw[BENCH_SAMPLES];
+	fillBenchData(raw, BENCH_SAMPLES);
+	for (size_t i = 0; i < sizeof(benchCalibs) / sizeof(benchCalibs[0]); i++) {
+		benchKernels(&benchCalibs[i], raw, BENCH_SAMPLES);
+		benchPipeline(&benchCalibs[i], raw, BENCH_SAMPLES);
+		benchIo(&benchCalibs[i]);
+		fflush(stdout);
+	}
+}
+
+//endpoint of the push selftest on a loopback port, answers the first fail requests with 503 and accepts the later ones
+struct PushStub
+{
+	int fd; //listening
+	int fail;
+	atomic_int requests;
+	atomic_size_t gotLen;
+	char got[1024]; //bodies accepted, in the order they came
+};
+
+void * pushStub(void * arg) {
+	struct PushStub * st = arg;
+	char buf[2048], * body, * cl;
+	int c;
+	while ((c = accept(st->fd, NULL, NULL)) >= 0) {
+		size_t len = 0, reqLen, bodyLen;
+		ssize_t n;
+		//requests on a kept-alive connection are answered once their body is complete
+		while ((n = recv(c, buf + len, sizeof(buf) - 1 - len, 0)) > 0) {
+			len += n;
+			buf[len] = 0;
+			while ((body = strstr(buf, "\r\n\r\n")) != NULL) {
+				cl = strstr(buf, "Content-Length:");
+				bodyLen = cl && cl < body ? strtoul(cl + 15, NULL, 10) : 0;
+				body += 4;
+				reqLen = body - buf + bodyLen;
+				if (len < reqLen) break;
+				bool accepted = atomic_fetch_add(&st->requests, 1) >= st->fail;
+				size_t gotLen = atomic_load(&st->gotLen);
+				if (accepted && gotLen + bodyLen <= sizeof(st->got)) {
+					memcpy(st->got + gotLen, body, bodyLen);
+					atomic_store(&st->gotLen, gotLen + bodyLen);
+				}
+				const char * resp = accepted ? "HTTP/1.1 204 No Content\r\n\r\n" : "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+				send(c, resp, strlen(resp), MSG_NOSIGNAL);
+				len -= reqLen;
+				memmove(buf, buf + reqLen, len + 1);
+			}
+		}
+		close(c);
+	}
+	return NULL;
+}
+
+//batches of two samples to a stub endpoint that refuses the first request: the first batch is spooled, the second
+//is queued behind it in the spool instead of overtaking it, and after the retry backoff both arrive in order
+bool selftestPush() {
+	static struct PushStub st;
+	struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t addrLen = sizeof(addr);
+	char spool[] = "/tmp/bme280-selftest-XXXXXX", url[64];
+	pthread_t thread;
+	bool ok;
+
+	int fd = mkstemp(spool);
+	if (fd < 0) return false;
+	close(fd);
+	memset(&st, 0, sizeof(st));
+	st.fail = 1;
+	st.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (st.fd < 0 || bind(st.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(st.fd, 4) < 0 ||
+		getsockname(st.fd, (struct sockaddr *)&addr, &addrLen) < 0 || pthread_create(&thread, NULL, pushStub, &st) != 0) {
+		perror("selftestPush() stub endpoint failed");
+		if (st.fd >= 0) close(st.fd);
+		unlink(spool);
+		return false;
+	}
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/write", ntohs(addr.sin_port));
+	ok = startPush(url, spool, 2, 60000);
+	for (int i = 0; ok && i < 4; i++) {
+		struct Data data = { 101325 * 256, 2000 + i, 50 * 1024 };
+		pushSample("/dev/i2c-test", BME280_I2C_ADDR_PRIM, &data, (i + 1) * 1000000000LL);
+		//the first batch is refused before the second is queued
+		for (int ms = 0; i == 1 && ms < 2000 && atomic_load(&st.requests) == 0; ms++) usleep(1000);
+	}
+	for (int ms = 0; ok && ms < PUSH_RETRY_MIN_MS + 4000 && atomic_load(&st.requests) < 2; ms++) usleep(1000);
+	if (ok) stopPush();
+	shutdown(st.fd, SHUT_RDWR);
+	pthread_join(thread, NULL);
+	close(st.fd);
+	unlink(spool);
+
+	//four lines, timestamps 1 to 4 s in order, from one refused and one accepted request
+	char * line = st.got, * end = st.got + atomic_load(&st.gotLen);
+	long long t;
+	int lines = 0;
+	ok &= atomic_load(&st.requests) == 2;
+	for (; ok && line < end; lines++) {
+		char * nl = memchr(line, '\n', end - line);
+		double v;
+		ok = nl && sscanf(line, "bme280,bus=i2c-test,addr=76 t=%lf,h=%*f,p=%*f %lld", &v, &t) == 2 && llround(v * 100) == 2000 + lines &&
+			t == (lines + 1) * 1000000000LL;
+		line = nl + 1;
+	}
+	return ok && lines == 4;
+}
+
+//true if data holds expected in the channels compiled into the core and is untouched (unset) in the others,
+//so a build with a reduced BME280_CORE_CHANNELS is checked against the results of the full one
+bool isCompensated(const struct Data * data, const struct Data * expected, const struct Data * unset) {
+	return data->t == expected->t &&
+		data->p == (BME280_CORE_CHANNELS & BME280_PRESS ? expected->p : unset->p) &&
+		data->h == (BME280_CORE_CHANNELS & BME280_HUM ? expected->h : unset->h);
+}
+
+//compares the calibration words of the channels compiled into the core
+bool isCalibrated(const struct CalibData * c, const struct CalibData * expected) {
+	bool ok = memcmp(c, expected, offsetof(struct CalibData, dig_P1)) == 0;
+	if (BME280_CORE_CHANNELS & BME280_PRESS)
+		ok &= memcmp(&c->dig_P1, &expected->dig_P1, offsetof(struct CalibData, dig_H1) - offsetof(struct CalibData, dig_P1)) == 0;
+	if (BME280_CORE_CHANNELS & BME280_HUM)
+		ok &= c->dig_H1 == expected->dig_H1 && c->dig_H2 == expected->dig_H2 && c->dig_H3 == expected->dig_H3 &&
+			c->dig_H4 == expected->dig_H4 && c->dig_H5 == expected->dig_H5 && c->dig_H6 == expected->dig_H6;
+	return ok;
+}
+
+//known-answer and round-trip checks of the driver core against the software sensor, needs no sensor,
+//with -DBME280_CORE_CHANNELS the reduced core is checked against the answers of the full one
+//prints one line per check and returns the number of failed ones
+int selftest() {
+	struct Device dev;
+	struct Emu emu;
+	struct Data data;
+	struct UncompData raw, back;
+	uint8_t regData[BME280_P_T_H_DATA_LEN];
+	const struct Data unset = { 0xA5A5A5A5, (int32_t)0xA5A5A5A5, 0xA5A5A5A5 };
+	int failed = 0, n;
+	bool ok;
+
+	printf("selftest channels compiled in:%s%s%s\n", BME280_CORE_CHANNELS & BME280_TEMP ? " t" : "",
+		BME280_CORE_CHANNELS & BME280_PRESS ? " p" : "", BME280_CORE_CHANNELS & BME280_HUM ? " h" : "");
+
+	//Bosch reference formulas, datasheet section 4.2.3, evaluated in signed 32 and 64-bit arithmetic for the typical calibration.
+	//The datasheet's own example calibration has a negative dig_T3, where compensateT() differs, see typicalCalibData in bme280_emu.c
+	raw = (struct UncompData){ 415148, 519888, 27000 };
+	data = unset;
+	compensateData(BME280_ALL, &raw, &data, &benchCalibs[1].calibData);
+	ok = isCompensated(&data, &(struct Data){ 22287594, 2044, 29142 }, &unset);
+	printf("selftest reference compensation: %s t=%d p=%u h=%u\n", ok ? "ok" : "FAILED", data.t, data.p, data.h);
+	failed += !ok;
+
+	//batch kernels on every code path agree with the core, they compensate all channels whatever it has compiled in
+	ok = true;
+	for (size_t i = 0; i < 3 * sizeof(benchCalibs) / sizeof(benchCalibs[0]); i++) {
+		static struct UncompData raws[64];
+		if (!setBatchImpl(BATCH_IMPL_SCALAR + i % 3)) continue;
+		uint32_t raw_t[64], raw_p[64], raw_h[64], p[64], h[64];
+		int32_t t[64], t_fine[64];
+		fillBenchData(raws, 64);
+		for (int j = 0; j < 64; j++) {
+			raw_t[j] = raws[j].t; raw_p[j] = raws[j].p; raw_h[j] = raws[j].h;
+		}
+		compensateBatch(&benchCalibs[i / 3].calibData, raw_t, raw_p, raw_h, t, p, h, t_fine, 64);
+		for (int j = 0; j < 64; j++) {
+			data = unset;
+			compensateData(BME280_ALL, &raws[j], &data, &benchCalibs[i / 3].calibData);
+			ok &= isCompensated(&data, &(struct Data){ p[j], t[j], h[j] }, &unset);
+		}
+	}
+	setBatchImpl(BATCH_IMPL_AUTO);
+	printf("selftest batch compensation: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	//data registers
+	ok = true;
+	for (uint32_t i = 0; i < 1000; i++) {
+		raw = (struct UncompData){ (i * 1048573u) & 0xFFFFF, (i * 524309u) & 0xFFFFF, (i * 65521u) & 0xFFFF };
+		encodeData(&raw, regData);
+		parseData(regData, &back);
+		ok &= memcmp(&raw, &back, sizeof(raw)) == 0;
+	}
+	printf("selftest data registers: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	//host filters: a median rejects a spike, an EMA and a Kalman filter converge to a step
+	struct FilterChain chain;
+	struct Filter filter;
+	ok = true;
+	parseFilterChain("median:3", &chain);
+	initFilter(&filter, &chain);
+	for (int i = 0; i < 5; i++) {
+		data = (struct Data){ 25600000, i == 2 ? 9000 : 2500, 51200 };
+		applyFilter(&filter, BME280_ALL, &data, &data);
+		ok &= data.t == 2500 && data.p == 25600000 && data.h == 51200;
+	}
+	parseFilterChain("ema:0.5,kalman:0.01", &chain);
+	initFilter(&filter, &chain);
+	for (int i = 0; i < 200; i++) {
+		data = (struct Data){ 0, i == 0 ? 0 : 1000, 0 };
+		applyFilter(&filter, BME280_TEMP, &data, &data);
+	}
+	ok &= data.t == 1000;
+	printf("selftest host filters: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	//capture records read back as written, sample times across a gap longer than a uint32 of us included
+	struct Capture capture = { .f = tmpfile() };
+	struct CaptureDevice cd = { .id = 1, .bus = "i2c-1", .addr = BME280_I2C_ADDR_SEC, .regs = { 5, 0, 0xB7, 0x10 } };
+	struct CaptureRecord rec;
+	int64_t times[] = { 1700000000123456789, 1700000000223456789, 1700000000223457000, 1700009000000000000 };
+	ok = capture.f != NULL;
+	for (n = 0; ok && n < CAPTURE_CALIB_LEN; n++) cd.calib[n] = n * 7;
+	ok = ok && writeCaptureDevice(&capture, &cd);
+	for (n = 0; ok && n < 4; n++) {
+		memset(regData, n, sizeof(regData));
+		ok = writeCaptureSample(&capture, cd.id, times[n], regData);
+	}
+	if (capture.f) rewind(capture.f);
+	capture.timed = false;
+	for (n = 0; ok && readCapture(&capture, &rec) == 1;) {
+		if (rec.type == CAPTURE_DEVICE) ok = memcmp(&rec.device, &cd, sizeof(cd)) == 0;
+		if (rec.type != CAPTURE_SAMPLE) continue;
+		memset(regData, n, sizeof(regData));
+		//times are kept to the us
+		ok = rec.id == cd.id && llabs(rec.time_ns - times[n]) < 1000 && memcmp(rec.regData, regData, sizeof(regData)) == 0;
+		n++;
+	}
+	ok &= n == 4;
+	closeCapture(&capture);
+	printf("selftest capture records: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	//stream samples read back as written, a clock stepped back included, and a deadband passes changes and heartbeats
+	static struct StreamState wst, rst;
+	struct StreamSample ss[4] = { { times[0], 25939182, 2500, 51205 }, { times[1], 25939100, 2501, 51300 },
+		{ times[0], 0, -4000, 0 }, { times[3], 26000000, 8500, 102400 } }, got;
+	const char * name;
+	uint8_t id;
+	FILE * f = tmpfile();
+	ok = f && writeStreamHeader(f);
+	for (n = 0; ok && n < 4; n++) ok = writeStreamSample(f, &wst, n % 2 + 3, n % 2 ? "spidev0.0" : "i2c-1:76", &ss[n]);
+	if (f) rewind(f);
+	ok = ok && readStreamHeader(f);
+	for (n = 0; ok && n < 4; n++)
+		ok = readStreamSample(f, &rst, &id, &name, &got) == 1 && id == n % 2 + 3 && strcmp(name, n % 2 ? "spidev0.0" : "i2c-1:76") == 0 &&
+			got.time_ns / 1000 == ss[n].time_ns / 1000 && got.t == ss[n].t && got.p == ss[n].p && got.h == ss[n].h;
+	ok = ok && readStreamSample(f, &rst, &id, &name, &got) == 0;
+	if (f) fclose(f);
+	struct Deadband db = { 0, 0, 0, 1000000000 };
+	struct DeadbandState dbs = { false, 0, { 0, 0, 0 } };
+	ok &= parseDeadband("t=0.1,h=0.5,p=0.05", &db) && db.t == 10 && db.p == 1280 && db.h == 512;
+	data = (struct Data){ 25600000, 2500, 51200 };
+	ok &= passDeadband(&db, &dbs, BME280_ALL, 0, &data);
+	data.t += 9;
+	ok &= !passDeadband(&db, &dbs, BME280_ALL, 100000000, &data);
+	data.t += 1;
+	ok &= passDeadband(&db, &dbs, BME280_ALL, 200000000, &data) && !passDeadband(&db, &dbs, BME280_ALL, 300000000, &data);
+	ok &= passDeadband(&db, &dbs, BME280_ALL, 1200000000, &data);
+	printf("selftest stream and deadband: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	ok = selftestPush();
+	printf("selftest push exporter: %s\n", ok ? "ok" : "FAILED");
+	failed += !ok;
+
+	cacheDir = NULL;
+	memset(&dev, 0, sizeof(dev));
+	strcpy(dev.bus, BME280_EMU_DEVICE);
+	dev.addr = BME280_I2C_ADDR_PRIM;
+	dev.transport = &emuTransport;
+	dev.priv = &emu;
+	dev.xfer = I2C_XFER_RDWR;
+
+	//calibration registers of each calibration set read back as that set
+	for (size_t i = 0; i < sizeof(benchCalibs) / sizeof(benchCalibs[0]); i++) {
+		struct CalibData calibData;
+		initEmu(&emu, &benchCalibs[i].calibData);
+		memset(&calibData, 0, sizeof(calibData));
+		ok = getCalibData(&dev, &calibData) && isCalibrated(&calibData, &benchCalibs[i].calibData);
+		printf("selftest calibration %s: %s\n", benchCalibs[i].name, ok ? "ok" : "FAILED");
+		failed += !ok;
+	}
+
+	//every preset from a cold setup and switched to from the previous one without a reset, over I2C and then over SPI,
+	//the registers must hold the preset and a sample must be near what the software sensor measures,
+	//on SPI a reconfiguration must be a single write transaction
+	static struct SpiEmu se;
+	openSpi(&se.spi, BME280_EMU_SPI_DEVICE, SPI_DEFAULT_SPEED_HZ, &se.emu);
+	for (int spi = 0; spi < 2; spi++) {
+		struct Emu * e = spi ? &se.emu : &emu;
+		initEmu(e, NULL);
+		if (spi) {
+			strcpy(dev.bus, BME280_EMU_SPI_DEVICE);
+			dev.transport = &spiTransport;
+			dev.priv = &se.spi;
+			dev.xfer = SPI_XFER;
+		}
+		for (n = 0; n < 2 * presetsCount; n++) {
+			const struct Profile * profile = &presets[n % presetsCount];
+			struct Settings s;
+			uint64_t writes = e->writes;
+			if (n == 0) {
+				dev.settings = profile->settings;
+				dev.mode = profile->mode;
+				setup(&dev);
+				ok = true;
+			} else ok = reconfigure(&dev, &profile->settings, profile->mode) && (!spi || e->writes - writes <= 1);
+			parseSettings(&e->regs[BME280_CTRL_HUM_ADDR], &s);
+			ok &= memcmp(&s, &profile->settings, sizeof(s)) == 0 &&
+				(e->regs[BME280_CTRL_MEAS_ADDR] & BME280_SENSOR_MODE_MSK) == (profile->mode == BME280_FORCED_MODE ? BME280_SLEEP_MODE : BME280_NORMAL_MODE);
+			if (profile->mode == BME280_FORCED_MODE) {
+				struct timespec started;
+				clock_gettime(CLOCK_MONOTONIC, &started);
+				startForced(&dev);
+				finishForced(&dev, &started);
+			} else readDevice(&dev, true);
+			uint8_t dataType = getDataType(&profile->settings);
+			ok &= dev.ok && abs(dev.data.t - 2500) <= 5 && (!(dataType & BME280_PRESS) || abs((int32_t)(dev.data.p / 256) - 101325) <= 5) &&
+				(!(dataType & BME280_HUM) || abs((int32_t)dev.data.h - 50 * 1024) <= 10);
+			printf("selftest %s%s %s: %s t=%d p=%u h=%u\n", n == 0 ? "setup" : "reconfigure", spi ? " spi" : "", profile->name, ok ? "ok" : "FAILED", dev.data.t, dev.data.p, dev.data.h);
+			failed += !ok;
+		}
+	}
+	cacheDir = BME280_CACHE_DIR;
+	return failed;
+}
+
+//devices of a capture and the shortest interval between their samples within the first
+//CAPTURE_SCAN_RECORDS records, which sizes windows as the sampling interval does, then rewinds to the first record
+void scanCapture(struct Capture * c, int * ndevs, uint32_t * interval_us) {
+	struct CaptureRecord rec;
+	int64_t last[256];
+	bool seen[256] = { false };
+	uint64_t shortest = 0;
+	long start = ftell(c->f);
+	*ndevs = 0;
+	for (int n = 0; n < CAPTURE_SCAN_RECORDS && readCapture(c, &rec) == 1; n++) {
+		if (rec.type == CAPTURE_DEVICE) {
+			if (!seen[rec.device.id]) (*ndevs)++;
+			seen[rec.device.id] = true;
+			last[rec.device.id] = 0;
+		}
+		if (rec.type != CAPTURE_SAMPLE) continue;
+		if (last[rec.id] && rec.time_ns > last[rec.id] && (shortest == 0 || (uint64_t)(rec.time_ns - last[rec.id]) < shortest)) shortest = rec.time_ns - last[rec.id];
+		last[rec.id] = rec.time_ns;
+	}
+	if (shortest >= 1000) *interval_us = shortest / 1000;
+	fseek(c->f, start, SEEK_SET);
+	c->timed = false;
+}
+
+//the recorded settings and calibration of a device replace those of the device of the same bus and address
+struct Device * replayDevice(const struct CaptureDevice * cd, struct Device * devs, int * ndevs, const struct FilterChain * chain) {
+	int i;
+	for (i = 0; i < *ndevs && (strcmp(devs[i].bus, cd->bus) != 0 || devs[i].addr != cd->addr); i++);
+	if (i == *ndevs) {
+		if (i == MAX_DEVICES) return NULL;
+		memset(&devs[i], 0, sizeof(struct Device));
+		snprintf(devs[i].bus, sizeof(devs[i].bus), "%s", cd->bus);
+		devs[i].addr = cd->addr;
+		devs[i].fd = -1;
+		if (isSpiDevice(devs[i].bus)) devs[i].xfer = SPI_XFER;
+		initFilter(&devs[i].filter, chain);
+		(*ndevs)++;
+	}
+	struct Device * dev = &devs[i];
+	memcpy(dev->regs, cd->regs, sizeof(dev->regs));
+	parseSettings(dev->regs, &dev->settings);
+	memcpy(dev->calib, cd->calib, sizeof(dev->calib));
+	parseTempPresCalibData(dev->calib, &dev->calibData);
+	parseHumidCalibData(dev->calib + BME280_TEMP_PRESS_CALIB_DATA_LEN, &dev->calibData);
+	return dev;
+}
+
+//feeds the samples of a capture through compensateBurst(), the filters and the writer, the same path sensor reads take,
+//as fast as possible or, with pace > 0, at pace times the original speed, returns the number of samples replayed
+uint64_t replayCapture(struct Capture * c, struct Device * devs, int * ndevs, struct Writer * w, const struct FilterChain * chain, double pace) {
+	struct CaptureRecord rec;
+	struct OutputSample sample;
+	struct Device * byId[256] = { NULL };
+	struct timespec start, at;
+	int64_t first_ns = 0, last_ns = 0;
+	uint64_t count = 0;
+	int r;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!stop && (r = readCapture(c, &rec)) != 0) {
+		if (r < 0) {
+			printf("error: unknown capture record type %d\n", rec.type);
+			break;
+		}
+		if (rec.type == CAPTURE_DEVICE) {
+			if ((byId[rec.device.id] = replayDevice(&rec.device, devs, ndevs, chain)) == NULL)
+				printf("error: capture has more than %d devices, %s:%02x is skipped\n", MAX_DEVICES, rec.device.bus, rec.device.addr);
+			continue;
+		}
+		if (rec.type != CAPTURE_SAMPLE || !byId[rec.id]) continue;
+		struct Device * dev = byId[rec.id];
+		if (pace > 0) {
+			//a clock stepped back during the capture starts the schedule over from the previous sample
+			if (first_ns == 0 || rec.time_ns < last_ns) {
+				if (first_ns != 0) start = at;
+				first_ns = rec.time_ns;
+			}
+			last_ns = rec.time_ns;
+			at = start;
+			addUs(&at, (rec.time_ns - first_ns) / 1000 / pace);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR && !stop);
+		}
+		memset(&dev->data, 0, sizeof(dev->data));
+		dev->ok = compensateBurst(dev, rec.regData, getDataType(&dev->settings), &dev->data);
+		sample.time_ns = rec.time_ns;
+		sample.dev = dev - devs;
+		sample.ok = dev->ok;
+		sample.calibRead = true;
+		memcpy(sample.regs, dev->regs, sizeof(sample.regs));
+		memcpy(sample.regData, rec.regData, sizeof(sample.regData));
+		sample.raw = dev->raw;
+		sample.data = dev->data;
+		if (dev->ok && chain->n) applyFilter(&dev->filter, getDataType(&dev->settings), &dev->data, &sample.filtered);
+		if (dev->ok || w->capture) pushRing(&w->ring, &sample);
+		count++;
+	}
+	return count;
+}
+
+void usage() {
+	printf("Usage: bme280 <i2c-dev>[:addr]|<spidev>[,<i2c-dev>[:addr]|<spidev>...] [sampling_interval] [number_of_samples] [--raw] [--daemon] [--stats]\n");
+	printf("       bme280 --replay <file> [--pace <factor>] [--raw] [--stats]\n");
+	printf("       bme280 --bench\n");
+	printf("       bme280 --selftest\n");
+	printf("  addr      sensor address, %x (default) or %x\n", BME280_I2C_ADDR_PRIM, BME280_I2C_ADDR_SEC);
+	printf("  spidev    4-wire SPI device, i.e. /dev/spidev0.0, \"%s\" is the software sensor on SPI\n", BME280_EMU_SPI_DEVICE);
+	printf("  sampling_interval  seconds (1, 0.5), milliseconds (100ms) or rate (10hz), default %d\n", DEFAULT_SAMPLING_RATE_SEC);
+	printf("  --raw     print t=..&h=..&p=.. for use in URLs\n");
+	printf("  --daemon  keep sampling and publish samples to shared memory for bme280c instead of printing them\n");
+	printf("  --log <file>  append samples to a binary log instead of printing them, read it with bme280log\n");
+	printf("  --log-records <n>  log capacity, the oldest records are overwritten, default %d\n", BME280_LOG_DEFAULT_RECORDS);
+	printf("  --forced  trigger a single low-noise measurement per sample and keep the sensor asleep in between,\n");
+	printf("            uses 1x oversampling and no IIR filter, best for sampling once a minute or less often, same as --profile weather\n");
+	printf("  --profile <preset>[,<setting>=<value>...]  oversampling, filter, standby time and mode of all devices, presets:\n");
+	printf("            default, weather, humidity, indoor, gaming, settings: osr_t, osr_p, osr_h=0|1|2|4|8|16, filter=0|2|4|8|16,\n");
+	printf("            standby=0.5|10|20|62.5|125|250|500|1000 (ms), mode=normal|forced, i.e. --profile indoor,standby=62.5\n");
+	printf("  --config <file>  profiles of devices, one \"<i2c-dev>[:addr] <profile>\" per line, others use --profile,\n");
+	printf("            kill -HUP re-reads it and changes the settings of running sensors without a reset\n");
+	printf("  --list-profiles  print the presets with their conversion time, output data rate and filter response\n");
+	printf("  --window <length>[/<step>]  print min, max and average over windows of length every step instead of samples,\n");
+	printf("            in ms, s (default), m or h, windows end on multiples of step, i.e. --window 1m or --window 1h/1m,\n");
+	printf("            --log gets the averages and --push the aggregates as well, --stream and shared memory get every sample\n");
+	printf("  --filter <stage>[,<stage>...]  filter samples on the host: ema:<alpha>, median:<n> or kalman:<noise_ratio>,\n");
+	printf("            i.e. --filter median:5,ema:0.2, best with the on-chip filter off (--profile ...,filter=0) for a fast raw stream\n");
+	printf("  --filtered <output>[,<output>...]  outputs getting the filtered samples: print, log, push, shm, metrics, window,\n");
+	printf("            stream, default print,log,push,window,stream, the others get the samples as read,\n");
+	printf("            i.e. bme280c and /metrics for control loops\n");
+	printf("  --deadband t=<deg C>,h=<%%RH>,p=<hPa>  output a sample only when a channel has moved by this much since the\n");
+	printf("            last one output, i.e. --deadband t=0.1,h=0.5,p=0.05, channels not given do not trigger output,\n");
+	printf("            applies to printing, --log, --push and --stream, --window and shared memory get every sample\n");
+	printf("  --heartbeat <duration>  output a sample at least this often whatever the deadband, in ms, s (default), m or h\n");
+	printf("  --stream <file>  write samples as a compact delta encoded binary stream instead of printing them, - for stdout,\n");
+	printf("            read it with bme280stream, about 8 bytes a sample\n");
+	printf("  --metrics [<host>:]<port>  serve the latest samples at http://host:port/metrics in Prometheus text format,\n");
+	printf("            scrapes are answered from memory and cause no I2C traffic\n");
+	printf("  --push <url>  send samples to http://host[:port]/path in Influx line protocol instead of printing them,\n");
+	printf("            i.e. http://localhost:8086/write?db=env, undelivered batches are spooled and replayed in order\n");
+	printf("  --push-batch <samples>[/<max_age>]  samples per request and the longest a sample waits, default %d/%ds\n", PUSH_DEFAULT_BATCH, PUSH_DEFAULT_AGE_MS / 1000);
+	printf("  --push-spool <file>  where undelivered batches wait, default %s\n", PUSH_DEFAULT_SPOOL);
+	printf("  --queue <samples>  samples waiting for output while sampling goes on, default %d\n", WRITER_QUEUE);
+	printf("  --backpressure drop-oldest|drop-newest|block  what a full queue does, default drop-oldest,\n");
+	printf("            block delays sampling until the output catches up\n");
+	printf("  --capture <file>  append the raw data registers of every burst read with settings and calibration to file,\n");
+	printf("            about 14 bytes a sample, corrupt bursts included\n");
+	printf("  --replay <file>  compensate, filter and output a capture instead of reading sensors, with --log, --push, --window,\n");
+	printf("            --filter or --capture as well, default backpressure block\n");
+	printf("  --pace <factor>  replay at factor times the original speed, i.e. 1 or 10, default 0, as fast as possible\n");
+	printf("  --stats   print achieved rate, missed deadlines, wake-up jitter histogram, output queue and bus transaction\n");
+	printf("            statistics to stderr at exit, kill -USR1 prints the bus transaction and output queue statistics at any time\n");
+	printf("  --bench   benchmark compensation, output formatting and bus transactions against a simulated sensor,\n");
+	printf("            prints one JSON object per line, needs no sensor\n");
+	printf("  --selftest  check compensation, register encoding, setup and reconfiguration against a simulated sensor,\n");
+	printf("            and the push exporter against a loopback endpoint, exits with the number of failed checks\n");
+	printf("  --spi-speed <hz>  SPI clock, default %d\n", SPI_DEFAULT_SPEED_HZ);
+	printf("  --emu <options>  options of the software sensor used as i2c-dev \"%s\" or spidev \"%s\", comma separated:\n", BME280_EMU_DEVICE, BME280_EMU_SPI_DEVICE);
+	printf("            t=, p=, h=<base>[:<amplitude>:<period_s>[:<noise>]] waveform in deg C, hPa, %%RH\n");
+	printf("            latency=<us> per transaction, nack=<probability>, stuck=<reg>:<value> in hex, reset=<us>, seed=<n>\n");
+	printf("number_of_samples 0 samples until interrupted, it is the default with --daemon\n");
+	printf("with several devices, each sample line is prefixed with the device, i.e. i2c-1:77\n");
 }
 
 int main(int argc, char ** argv) {
-	int res, counter = 0;
+	int i, j, opt, counter = 0;
+	bool raw = false, daemon = false, printStatsAtExit = false;
+	struct Profile profile = presets[0];
+	const char * configPath = NULL;
+	const char * logPath = NULL, * metricsAddress = NULL, * pushUrl = NULL, * pushSpool = PUSH_DEFAULT_SPOOL;
+	uint32_t pushBatch = PUSH_DEFAULT_BATCH, pushAgeMs = PUSH_DEFAULT_AGE_MS;
+	uint64_t logRecords = BME280_LOG_DEFAULT_RECORDS;
+	uint64_t windowLength = 0, windowStep = 0;
+	struct FilterChain filterChain = { .n = 0 };
+	uint8_t filtered = OUTPUT_FILTERED_DEFAULT;
+	uint32_t queueCapacity = WRITER_QUEUE;
+	int backpressure = RING_DROP_OLDEST;
+	bool backpressureSet = false;
+	const char * capturePath = NULL, * replayPath = NULL;
+	double pace = 0;
+	static struct Capture capture, replayed;
+	struct Deadband deadband = { 0, 0, 0, 0 };
+	bool deadbandSet = false;
+	const char * streamPath = NULL;
+	static struct option options[] = {
+		{ "log", required_argument, NULL, 'l' },
+		{ "log-records", required_argument, NULL, 'L' },
+		{ "raw", no_argument, NULL, 'r' },
+		{ "daemon", no_argument, NULL, 'd' },
+		{ "stats", no_argument, NULL, 's' },
+		{ "forced", no_argument, NULL, 'F' },
+		{ "profile", required_argument, NULL, 'p' },
+		{ "config", required_argument, NULL, 'c' },
+		{ "list-profiles", no_argument, NULL, 'R' },
+		{ "bench", no_argument, NULL, 'b' },
+		{ "selftest", no_argument, NULL, 'T' },
+		{ "emu", required_argument, NULL, 'e' },
+		{ "spi-speed", required_argument, NULL, 'z' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "filter", required_argument, NULL, 'f' },
+		{ "filtered", required_argument, NULL, 'o' },
+		{ "queue", required_argument, NULL, 'q' },
+		{ "backpressure", required_argument, NULL, 'k' },
+		{ "deadband", required_argument, NULL, 'D' },
+		{ "heartbeat", required_argument, NULL, 'H' },
+		{ "stream", required_argument, NULL, 'x' },
+		{ "capture", required_argument, NULL, 'C' },
+		{ "replay", required_argument, NULL, 'y' },
+		{ "pace", required_argument, NULL, 'a' },
+		{ "metrics", required_argument, NULL, 'm' },
+		{ "push", required_argument, NULL, 'P' },
+		{ "push-spool", required_argument, NULL, 'S' },
+		{ "push-batch", required_argument, NULL, 'B' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
 
-	if (argc > 5 || argc < 2) {
-		printf("Usage: bme280 <i2c-dev> [sampling_rate_sec] [number_of_samples] [--raw]\n");
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (opt) {
+		case 'r': raw = true; break;
+		case 'd': daemon = true; break;
+		case 's': printStatsAtExit = true; break;
+		case 'F': parseProfile("weather", &profile); break;
+		case 'p':
+			if (!parseProfile(optarg, &profile)) return -1;
+			reportProfiles = true;
+			break;
+		case 'c':
+			configPath = optarg;
+			reportProfiles = true;
+			break;
+		case 'R':
+			for (i = 0; i < presetsCount; i++) printProfile(stdout, presets[i].name, &presets[i]);
+			return 0;
+		case 'b': bench(); return 0;
+		case 'T': return selftest();
+		case 'e': emuOptions = optarg; break;
+		case 'z':
+			spiSpeedHz = strtoul(optarg, NULL, 10);
+			if (spiSpeedHz == 0) {
+				printf("--spi-speed %s is not a clock rate in hz\n", optarg);
+				return -1;
+			}
+			break;
+		case 'm': metricsAddress = optarg; break;
+		case 'P': pushUrl = optarg; break;
+		case 'S': pushSpool = optarg; break;
+		case 'B': {
+			char * slash;
+			pushBatch = strtoul(optarg, &slash, 10);
+			uint32_t age_us = pushAgeMs * 1000;
+			if (pushBatch == 0 || (*slash && (*slash != '/' || !parseInterval(slash + 1, &age_us)))) {
+				printf("--push-batch %s is not <samples>[/<max_age>]\n", optarg);
+				return -1;
+			}
+			pushAgeMs = age_us / 1000;
+			break;
+		}
+		case 'w':
+			if (!parseWindow(optarg, &windowLength, &windowStep)) {
+				printf("--window %s is not <length>[/<step>] with step not longer than length\n", optarg);
+				return -1;
+			}
+			break;
+		case 'f':
+			if (!parseFilterChain(optarg, &filterChain)) return -1;
+			break;
+		case 'o':
+			if (!parseOutputs(optarg, &filtered)) {
+				printf("--filtered %s is not a list of print, log, push, shm, metrics, window and stream\n", optarg);
+				return -1;
+			}
+			break;
+		case 'q':
+			queueCapacity = strtoul(optarg, NULL, 10);
+			if (queueCapacity == 0 || queueCapacity > 1 << 20) {
+				printf("--queue %s is not a number of samples from 1 to %d\n", optarg, 1 << 20);
+				return -1;
+			}
+			break;
+		case 'k':
+			if (!parseBackpressure(optarg, &backpressure)) {
+				printf("--backpressure %s is not drop-oldest, drop-newest or block\n", optarg);
+				return -1;
+			}
+			backpressureSet = true;
+			break;
+		case 'D':
+			if (!parseDeadband(optarg, &deadband)) {
+				printf("--deadband %s is not a list of t=<deg C>, h=<%%RH> and p=<hPa>\n", optarg);
+				return -1;
+			}
+			deadbandSet = true;
+			break;
+		case 'H':
+			if (!parseDuration(optarg, optarg + strlen(optarg), &deadband.heartbeat_ns)) {
+				printf("--heartbeat %s is not a duration in ms, s (default), m or h\n", optarg);
+				return -1;
+			}
+			deadbandSet = true;
+			break;
+		case 'x': streamPath = optarg; break;
+		case 'C': capturePath = optarg; break;
+		case 'y': replayPath = optarg; break;
+		case 'a': {
+			char * end;
+			pace = strtod(optarg, &end);
+			if (*end || pace < 0) {
+				printf("--pace %s is not a speed factor, 1 is the original speed, 0 as fast as possible\n", optarg);
+				return -1;
+			}
+			break;
+		}
+		case 'l': logPath = optarg; break;
+		case 'L':
+			logRecords = strtoull(optarg, NULL, 10);
+			if (logRecords < BME280_LOG_INDEX_STRIDE || logRecords % BME280_LOG_INDEX_STRIDE != 0) {
+				printf("--log-records must be a multiple of %d\n", BME280_LOG_INDEX_STRIDE);
+				return -1;
+			}
+			break;
+		default: usage(); return -1;
+		}
+	}
+	argc -= optind; argv += optind;
+	if (!filterChain.n) filtered = 0;
+	if (replayPath ? argc > 0 || daemon || metricsAddress : argc > 3 || argc < 1) {
+		usage();
 		return -1;
 	}
-	char device[16];
 
-	int len = strlen(argv[1]);
-	int sampling_rate_sec = DEFAULT_SAMPLING_RATE_SEC;
+	if (argc >= 2 && !parseInterval(argv[1], &intervalUs)) {
+		printf("sampling_interval %s is not a number of seconds, ms or hz\n", argv[1]);
+		return -1;
+	}
+	int number_of_samples = daemon ? 0 : DEFAULT_NUMBER_OF_SAMPLES;
 	if (argc >= 3) {
 		if (!isdigit(argv[2][0])) {
-			printf("sampling_rate_sec %s is not a number\n", argv[2]);
-			return -1;
-		}
-		sampling_rate_sec = atoi(argv[2]);
-	}
-	int number_of_samples = DEFAULT_NUMBER_OF_SAMPLES;
-	if (argc >= 4) {
-		if (!isdigit(argv[3][0])) {
 			printf("number_of_samples %s is not a number\n", argv[2]);
 			return -1;
 		}
-		number_of_samples = atoi(argv[3]);
+		number_of_samples = atoi(argv[2]);
 	}
-	bool raw = false;
-	if (argc == 5) {
-		if (strncmp(argv[4], "--raw", 5) == 0) raw = true;
+
+	static struct Device devs[MAX_DEVICES];
+	static struct Bus buses[MAX_DEVICES];
+	struct Shm * shms[MAX_DEVICES] = { NULL };
+	int ndevs = 0, nbuses = 0;
+	char * arg, * saveptr;
+	//replay takes its devices from the capture and, unless told otherwise, waits for the output instead of dropping samples
+	if (replayPath) {
+		if (!openCapture(&replayed, replayPath, false)) return -1;
+		scanCapture(&replayed, &ndevs, &intervalUs);
+		if (!backpressureSet) backpressure = RING_BLOCK;
 	}
-	if (len >= 16) {
-		printf("error: i2c-dev string \'%s\' is too long, must be less than 16 chars\n", argv[1]);
-		return -1;
+	for (arg = replayPath ? NULL : strtok_r(argv[0], ",", &saveptr); arg; arg = strtok_r(NULL, ",", &saveptr)) {
+		if (ndevs == MAX_DEVICES) {
+			printf("error: too many devices, at most %d are supported\n", MAX_DEVICES);
+			return -1;
+		}
+		struct Device * dev = &devs[ndevs++];
+		if (!parseDevice(arg, dev) || !openDevice(dev) || !getProfile(dev, configPath, &profile, &dev->profile)) return -1;
+		dev->settings = dev->profile.settings;
+		dev->mode = dev->profile.mode;
+		initFilter(&dev->filter, &filterChain);
+		for (i = 0; i < nbuses && strcmp(buses[i].path, dev->bus) != 0; i++);
+		if (i == nbuses) buses[nbuses++].path = dev->bus;
+		buses[i].devs[buses[i].n++] = dev;
+		if (daemon && (shms[ndevs - 1] = openShm(dev, intervalUs)) == NULL) return -1;
 	}
-	strncpy(device, argv[1], strlen(argv[1]) + 1);
-
-	int fd = open(device, O_RDWR);
-	//printf("fd %d\n", fd);
-	if (fd < 0) {
-		perror("Unable to open i2c device");
+	struct LogHeader * log = NULL;
+	if (logPath && (log = openLog(logPath, logRecords)) == NULL) return -1;
+	if (capturePath && replayPath && strcmp(capturePath, replayPath) == 0) {
+		printf("error: --capture and --replay are the same file\n");
 		return -1;
 	}
-	res = ioctl(fd, I2C_RETRIES, I2C_DEV_RETRIES);
-	if (res < 0) {
-		perror("setting number of retries failed");
-		return -1;
+	if (capturePath && !openCapture(&capture, capturePath, true)) return -1;
+	capturing = capturePath != NULL;
+	static struct Window windows[MAX_DEVICES];
+	for (j = 0; windowLength && j < (replayPath ? MAX_DEVICES : ndevs); j++) initWindow(&windows[j], windowLength, windowStep, intervalUs);
+	static struct Writer writer;
+	writer.devs = devs;
+	writer.ndevs = ndevs;
+	writer.log = log;
+	writer.push = pushUrl != NULL;
+	writer.print = !daemon && !log && !pushUrl && !streamPath;
+	writer.raw = raw;
+	writer.windows = windowLength ? windows : NULL;
+	writer.filtered = filtered;
+	writer.capture = capturePath ? &capture : NULL;
+	writer.deadband = deadbandSet ? &deadband : NULL;
+	if (streamPath) {
+		//on stdout the stream keeps the descriptor to itself, messages printed later go to stderr
+		int fd = -1;
+		if (strcmp(streamPath, "-") == 0) {
+			fflush(stdout);
+			fd = dup(STDOUT_FILENO);
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+		writer.stream = strcmp(streamPath, "-") == 0 ? (fd >= 0 ? fdopen(fd, "wb") : NULL) : fopen(streamPath, "wb");
+		if (!writer.stream || !writeStreamHeader(writer.stream)) {
+			perror("Unable to open stream");
+			return -1;
+		}
 	}
-	res = ioctl(fd, I2C_TIMEOUT, I2C_TIMEOUT);
-	if (res < 0) {
-		perror("setting timeout failed");
+	if (!initRing(&writer.ring, queueCapacity, sizeof(struct OutputSample), backpressure)) {
+		perror("Unable to allocate the output queue");
 		return -1;
 	}
-	res = ioctl(fd, I2C_SLAVE, BME280_I2C_ADDR_PRIM);
-	if (res < 0) {
-		perror("setting slave address failed");
-		return -1;
+	writer.ring.stop = &stop;
+	setvbuf(stdout, NULL, _IOFBF, WRITER_BUFFER);
+	if (replayPath) {
+		//scanCapture() counted the devices to decide on prefixes, replay adds them as their records come
+		ndevs = 0;
+		signal(SIGINT, onSignal);
+		signal(SIGTERM, onSignal);
+		if (pushUrl && !startPush(pushUrl, pushSpool, pushBatch, pushAgeMs)) return -1;
+		pthread_create(&writer.thread, NULL, writerWorker, &writer);
+		clock_gettime(CLOCK_MONOTONIC, &stats.start);
+		stats.samples = replayCapture(&replayed, devs, &ndevs, &writer, &filterChain, pace);
+		closeRing(&writer.ring);
+		pthread_join(writer.thread, NULL);
+		if (printStatsAtExit) {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			double elapsed = diffUs(&now, &stats.start) / 1e6;
+			fprintf(stderr, "replayed %llu samples in %.3f s, rate %.1f samples/s\n", (unsigned long long)stats.samples, elapsed, elapsed > 0 ? stats.samples / elapsed : 0);
+			printWriterStats(&writer);
+		}
+		if (log) closeLog(log);
+		if (writer.stream) fclose(writer.stream);
+		if (pushUrl) stopPush();
+		closeCapture(&replayed);
+		closeCapture(&capture);
+		for (j = 0; windowLength && j < MAX_DEVICES; j++) freeWindow(&windows[j]);
+		freeRing(&writer.ring);
+		return 0;
 	}
-	
-	//i2c_funcs(fd);
+	static struct Metrics metrics[MAX_DEVICES];
+	for (j = 0; j < ndevs; j++) metrics[j].dev = &devs[j];
+	metricsCount = ndevs;
+	if (metricsAddress && !startHttp(metricsAddress, handleMetrics, metrics)) return -1;
+	if (pushUrl && !startPush(pushUrl, pushSpool, pushBatch, pushAgeMs)) return -1;
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	signal(SIGUSR1, onDump);
+	if (configPath) signal(SIGHUP, onReload);
 
-	setup(fd);
-	while (counter++ < number_of_samples)	loop(fd, sampling_rate_sec, raw);
-	close(fd);
+	pthread_barrier_init(&sweepStart, NULL, nbuses + 1);
+	pthread_barrier_init(&sweepDone, NULL, nbuses + 1);
+	//signals are delivered to this thread, so they interrupt its sleep
+	sigset_t block, old;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGUSR1);
+	sigaddset(&block, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+	for (i = 0; i < nbuses; i++) pthread_create(&buses[i].thread, NULL, busWorker, &buses[i]);
+	pthread_create(&writer.thread, NULL, writerWorker, &writer);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	//the first sample is read as soon as the sensors have completed a conversion,
+	//later ones on absolute deadlines, so read and print time do not accumulate as drift
+	//all devices read in one sweep share its timestamp
+	struct timespec ts, deadline, now;
+	struct OutputSample sample;
+	clock_gettime(CLOCK_MONOTONIC, &stats.start);
+	deadline = stats.start;
+	while (!stop && (number_of_samples == 0 || counter < number_of_samples)) {
+		if (counter++ > 0) {
+			addUs(&deadline, intervalUs);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			//if a sweep overran, skip the deadlines already passed instead of bursting to catch up
+			int64_t late = diffUs(&now, &deadline);
+			if (late >= (int64_t)intervalUs) {
+				uint64_t skip = late / intervalUs;
+				stats.missed += skip;
+				addUs(&deadline, skip * intervalUs);
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && !stop) {
+				if (!dumpInstr) continue;
+				dumpInstr = 0;
+				printDevicesInstr(devs, ndevs);
+				printWriterStats(&writer);
+			}
+			if (stop) break;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			recordJitter(diffUs(&now, &deadline));
+		}
+		//bus workers apply changed profiles at the start of the sweep
+		if (reloadProfiles) {
+			reloadProfiles = 0;
+			for (j = 0; j < ndevs; j++) {
+				struct Profile p;
+				if (getProfile(&devs[j], configPath, &profile, &p) && memcmp(&p, &devs[j].profile, sizeof(p)) != 0) {
+					devs[j].profile = p;
+					devs[j].reload = true;
+				}
+			}
+		}
+		clock_gettime(CLOCK_REALTIME, &ts);
+		pthread_barrier_wait(&sweepStart);
+		pthread_barrier_wait(&sweepDone);
+		//shared memory and /metrics are updated right away, they never block, the other outputs are left to the writer
+		for (j = 0; j < ndevs; j++) {
+			sample.time_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+			sample.dev = j;
+			sample.ok = devs[j].ok;
+			sample.calibRead = devs[j].calibRead;
+			memcpy(sample.regs, devs[j].regs, sizeof(sample.regs));
+			memcpy(sample.regData, devs[j].regData, sizeof(sample.regData));
+			sample.raw = devs[j].raw;
+			sample.data = devs[j].data;
+			//corrupt samples never reach the filter
+			if (devs[j].ok && filterChain.n) applyFilter(&devs[j].filter, getDataType(&devs[j].settings), &devs[j].data, &sample.filtered);
+			if (metricsAddress) {
+				atomic_fetch_add_explicit(&metrics[j].reads, 1, memory_order_relaxed);
+				if (!devs[j].ok) atomic_fetch_add_explicit(&metrics[j].errors, 1, memory_order_relaxed);
+				else publishData(&metrics[j].cache, getOutputData(&sample, filtered, OUTPUT_METRICS), &ts);
+			}
+			//a corrupt burst is still captured, replay reports it as the live run did
+			if (devs[j].ok && shms[j]) publishData(shms[j], getOutputData(&sample, filtered, OUTPUT_SHM), &ts);
+			if ((devs[j].ok && (log || pushUrl || windowLength || writer.print || writer.stream)) || (capturePath && devs[j].burst)) pushRing(&writer.ring, &sample);
+		}
+		stats.samples++;
+		if (dumpInstr) {
+			dumpInstr = 0;
+			printDevicesInstr(devs, ndevs);
+			printWriterStats(&writer);
+		}
+	}
+	//samples still queued are written before exit
+	closeRing(&writer.ring);
+	pthread_join(writer.thread, NULL);
+	if (printStatsAtExit) {
+		printStats();
+		printWriterStats(&writer);
+		printDevicesInstr(devs, ndevs);
+	}
+	if (log) closeLog(log);
+	if (writer.stream) fclose(writer.stream);
+	closeCapture(&capture);
+	if (metricsAddress) stopHttp();
+	if (pushUrl) stopPush();
+	quit = true;
+	pthread_barrier_wait(&sweepStart);
+	for (i = 0; i < nbuses; i++) pthread_join(buses[i].thread, NULL);
+	for (j = 0; j < ndevs; j++) {
+		if (shms[j]) closeShm(&devs[j], shms[j]);
+		if (windowLength) freeWindow(&windows[j]);
+		if (devs[j].fd >= 0) close(devs[j].fd);
+		free(devs[j].priv);
+	}
+	freeRing(&writer.ring);
 }
@@ -0,0 +1,135 @@
+//BME280 register map, settings and data structures shared by bme280.c and its helpers
+//Values and names follow the datasheet and Bosch driver https://github.com/BoschSensortec/BME280_driver
+
+#ifndef BME280_H
+#define BME280_H
+
+#include <stdint.h>
+
+//to enable SPI and disable i2c, CSB (chip select) -> GND
+#define BME280_I2C_ADDR_PRIM 0x76 //
+#define BME280_I2C_ADDR_SEC 0x77 //to change primary addr to secondary, SDO -> GND
+
+#define BME280_CHIP_ID 0x60
+
+//name Register Address
+#define BME280_CHIP_ID_ADDR 0xD0
+#define BME280_RESET_ADDR 0xE0
+#define BME280_TEMP_PRESS_CALIB_DATA_ADDR 0x88
+#define BME280_HUMIDITY_CALIB_DATA_ADDR 0xE1
+#define BME280_PWR_CTRL_ADDR 0xF4
+#define BME280_STATUS_ADDR 0xF3
+#define BME280_CTRL_HUM_ADDR 0xF2
+#define BME280_CTRL_MEAS_ADDR 0xF4
+#define BME280_CONFIG_ADDR 0xF5
+#define BME280_DATA_ADDR 0xF7
+
+#define BME280_TEMP_PRESS_CALIB_DATA_LEN 26
+#define BME280_HUMIDITY_CALIB_DATA_LEN 7
+#define BME280_P_T_H_DATA_LEN 8
+
+#define BME280_STATUS_IM_UPDATE_MSK 0x01 //NVM data is being copied to image registers
+#define BME280_STATUS_MEASURING_MSK 0x08 //conversion is running
+
+#define BME280_STARTUP_TIME_US 2000 //power on or soft reset to first communication
+#define BME280_RESET_TIMEOUT_US 20000
+#define BME280_POLL_MIN_US 50 //status polling backoff starts here and doubles up to BME280_POLL_MAX_US
+#define BME280_POLL_MAX_US 1000
+
+#define BME280_SENSOR_MODE_MSK 3
+#define BME280_SENSOR_MODE_POS 0
+#define BME280_CTRL_HUM_MSK 7
+#define BME280_CTRL_HUM_POS 0
+#define BME280_CTRL_PRESS_MSK 0x1C
+#define BME280_CTRL_PRESS_POS 2
+#define BME280_CTRL_TEMP_MSK 0xE0
+#define BME280_CTRL_TEMP_POS 5
+#define BME280_FILTER_MSK 0x1C
+#define BME280_FILTER_POS 2
+#define BME280_STANDBY_MSK 0xE0
+#define BME280_STANDBY_POS 5
+
+#define BME280_OSR_PRESS_SEL 1
+#define BME280_OSR_TEMP_SEL 2
+#define BME280_OSR_HUM_SEL 4
+#define BME280_FILTER_SEL 8
+#define BME280_STANDBY_SEL 16
+#define BME280_ALL_SETTINGS_SEL 0x1F
+
+#define BME280_NO_OVERSAMPLING 0x00
+#define BME280_OVERSAMPLING_1X 0x01
+#define BME280_OVERSAMPLING_2X 0x02
+#define BME280_OVERSAMPLING_4X 0x03
+#define BME280_OVERSAMPLING_8X 0x04
+#define BME280_OVERSAMPLING_16X 0x05
+
+#define BME280_FILTER_COEFF_OFF 0x00
+#define BME280_FILTER_COEFF_2 0x01
+#define BME280_FILTER_COEFF_4 0x02
+#define BME280_FILTER_COEFF_8 0x03
+#define BME280_FILTER_COEFF_16 0x04
+
+#define BME280_STANDBY_TIME_0_5_MS 0
+#define BME280_STANDBY_TIME_62_5_MS 1
+#define BME280_STANDBY_TIME_125_MS 2
+#define BME280_STANDBY_TIME_250_MS 3
+#define BME280_STANDBY_TIME_500_MS 4
+#define BME280_STANDBY_TIME_1000_MS 5
+#define BME280_STANDBY_TIME_10_MS 6
+#define BME280_STANDBY_TIME_20_MS 7
+
+#define BME280_SLEEP_MODE 0x00
+#define BME280_FORCED_MODE 0x01
+#define BME280_NORMAL_MODE 0x03
+
+#define BME280_PRESS 1
+#define BME280_TEMP 2
+#define BME280_HUM 4
+#define BME280_ALL 0x07
+
+#define OVERSAMPLING_SETTINGS 7
+#define FILTER_STANDBY_SETTINGS 0x18
+
+struct Settings
+{
+	uint8_t osr_p; //pressure oversampling
+	uint8_t osr_t; //temperature oversampling
+	uint8_t osr_h; //humidity oversampling
+	uint8_t filter; //filter coefficient
+	uint8_t standby_time; //standby time
+};
+struct Data
+{
+	uint32_t p; //pressure
+	int32_t t; //temperature
+	uint32_t h; //humidity
+};
+struct UncompData
+{
+	uint32_t p; //pressure
+	uint32_t t; //temperature
+	uint32_t h; //humidity
+};
+struct CalibData
+{
+	uint16_t dig_T1;
+	int16_t dig_T2;
+	int16_t dig_T3;
+	uint16_t dig_P1;
+	int16_t dig_P2;
+	int16_t dig_P3;
+	int16_t dig_P4;
+	int16_t dig_P5;
+	int16_t dig_P6;
+	int16_t dig_P7;
+	int16_t dig_P8;
+	int16_t dig_P9;
+	uint8_t dig_H1;
+	int16_t dig_H2;
+	uint8_t dig_H3;
+	int16_t dig_H4;
+	int16_t dig_H5;
+	int8_t dig_H6;
+};
+
+#endif
@@ -0,0 +1,223 @@
+//Batch compensation kernels, see bme280_batch.h
+//Every vector expression mirrors the C integer promotions of compensateT() and compensateH() in bme280_core.h:
+//terms computed from the unsigned raw value stay unsigned, so they are shifted right logically, the others arithmetically.
+//Multiplications keep the low 32 bits, exactly as 32-bit C arithmetic does.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bme280_batch.h"
+#include "bme280_core.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BATCH_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#define T_MIN -4000
+#define T_MAX 8500
+#define H_MAX 419430400
+
+static int batchImpl = BATCH_IMPL_AUTO;
+
+//the remainder of a vector loop and the scalar path are the core itself
+static inline int32_t compensateTScalar(const struct CalibData * calibData, uint32_t raw, int32_t * t_fine) {
+	struct UncompData data = { 0, raw, 0 };
+	return compensateT(&data, calibData, t_fine);
+}
+
+static inline uint32_t compensateHScalar(const struct CalibData * calibData, uint32_t raw, int32_t t_fine) {
+	struct UncompData data = { 0, 0, raw };
+	return compensateH(&data, calibData, t_fine);
+}
+
+static inline uint32_t compensatePScalar(const struct CalibData * calibData, uint32_t raw, int32_t t_fine) {
+	struct UncompData data = { raw, 0, 0 };
+	return compensateP(&data, calibData, t_fine);
+}
+
+#ifdef BATCH_HAVE_AVX2
+__attribute__((target("avx2")))
+static size_t compensateBatchTAvx2(const struct CalibData * calibData, const uint32_t * raw_t, int32_t * t, int32_t * t_fine, size_t n) {
+	const __m256i t1x2 = _mm256_set1_epi32((int32_t)calibData->dig_T1 << 1), t1 = _mm256_set1_epi32(calibData->dig_T1);
+	const __m256i t2 = _mm256_set1_epi32(calibData->dig_T2), t3 = _mm256_set1_epi32(calibData->dig_T3);
+	const __m256i five = _mm256_set1_epi32(5), round = _mm256_set1_epi32(128);
+	const __m256i tMin = _mm256_set1_epi32(T_MIN), tMax = _mm256_set1_epi32(T_MAX);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i raw = _mm256_loadu_si256((const __m256i *)(raw_t + i));
+		__m256i var1 = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_srli_epi32(raw, 3), t1x2), t2), 11);
+		__m256i d = _mm256_sub_epi32(_mm256_srli_epi32(raw, 4), t1);
+		__m256i var2 = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(d, d), 12), t3), 14);
+		__m256i tf = _mm256_add_epi32(var1, var2);
+		__m256i tv = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(tf, five), round), 8);
+		tv = _mm256_min_epi32(_mm256_max_epi32(tv, tMin), tMax);
+		_mm256_storeu_si256((__m256i *)(t_fine + i), tf);
+		_mm256_storeu_si256((__m256i *)(t + i), tv);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t compensateBatchHAvx2(const struct CalibData * calibData, const uint32_t * raw_h, const int32_t * t_fine, uint32_t * h, size_t n) {
+	const __m256i h1 = _mm256_set1_epi32(calibData->dig_H1), h2 = _mm256_set1_epi32(calibData->dig_H2), h3 = _mm256_set1_epi32(calibData->dig_H3);
+	const __m256i h4 = _mm256_set1_epi32((int32_t)((uint32_t)(int32_t)calibData->dig_H4 << 20)), h5 = _mm256_set1_epi32(calibData->dig_H5), h6 = _mm256_set1_epi32(calibData->dig_H6);
+	const __m256i c76800 = _mm256_set1_epi32(76800), c16384 = _mm256_set1_epi32(16384), c32768 = _mm256_set1_epi32(32768);
+	const __m256i c2097152 = _mm256_set1_epi32(2097152), c8192 = _mm256_set1_epi32(8192);
+	const __m256i zero = _mm256_setzero_si256(), hMax = _mm256_set1_epi32(H_MAX);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i raw = _mm256_loadu_si256((const __m256i *)(raw_h + i));
+		__m256i v = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(t_fine + i)), c76800);
+		//unsigned part: ((raw << 14) - (H4 << 20) - H5 * v + 16384) >> 15
+		__m256i x = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_slli_epi32(raw, 14), h4), _mm256_mullo_epi32(h5, v));
+		x = _mm256_srli_epi32(_mm256_add_epi32(x, c16384), 15);
+		//signed part: ((((v * H6 >> 10) * ((v * H3 >> 11) + 32768) >> 10) + 2097152) * H2 + 8192) >> 14
+		__m256i a = _mm256_srai_epi32(_mm256_mullo_epi32(v, h6), 10);
+		__m256i b = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(v, h3), 11), c32768);
+		__m256i y = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(a, b), 10), c2097152);
+		y = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y, h2), c8192), 14);
+		v = _mm256_mullo_epi32(x, y);
+		__m256i s = _mm256_srai_epi32(v, 15);
+		s = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(s, s), 7), h1), 4);
+		v = _mm256_sub_epi32(v, s);
+		v = _mm256_min_epi32(_mm256_max_epi32(v, zero), hMax);
+		_mm256_storeu_si256((__m256i *)(h + i), _mm256_srli_epi32(v, 12));
+	}
+	return i;
+}
+#endif
+
+#ifdef BATCH_HAVE_NEON
+static size_t compensateBatchTNeon(const struct CalibData * calibData, const uint32_t * raw_t, int32_t * t, int32_t * t_fine, size_t n) {
+	const uint32x4_t t1x2 = vdupq_n_u32((uint32_t)((int32_t)calibData->dig_T1 << 1)), t1 = vdupq_n_u32(calibData->dig_T1);
+	const uint32x4_t t2 = vdupq_n_u32((uint32_t)(int32_t)calibData->dig_T2), t3 = vdupq_n_u32((uint32_t)(int32_t)calibData->dig_T3);
+	const int32x4_t five = vdupq_n_s32(5), round = vdupq_n_s32(128);
+	const int32x4_t tMin = vdupq_n_s32(T_MIN), tMax = vdupq_n_s32(T_MAX);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32x4_t raw = vld1q_u32(raw_t + i);
+		uint32x4_t var1 = vshrq_n_u32(vmulq_u32(vsubq_u32(vshrq_n_u32(raw, 3), t1x2), t2), 11);
+		uint32x4_t d = vsubq_u32(vshrq_n_u32(raw, 4), t1);
+		uint32x4_t var2 = vshrq_n_u32(vmulq_u32(vshrq_n_u32(vmulq_u32(d, d), 12), t3), 14);
+		int32x4_t tf = vreinterpretq_s32_u32(vaddq_u32(var1, var2));
+		int32x4_t tv = vshrq_n_s32(vaddq_s32(vmulq_s32(tf, five), round), 8);
+		tv = vminq_s32(vmaxq_s32(tv, tMin), tMax);
+		vst1q_s32(t_fine + i, tf);
+		vst1q_s32(t + i, tv);
+	}
+	return i;
+}
+
+static size_t compensateBatchHNeon(const struct CalibData * calibData, const uint32_t * raw_h, const int32_t * t_fine, uint32_t * h, size_t n) {
+	const int32x4_t h1 = vdupq_n_s32(calibData->dig_H1), h2 = vdupq_n_s32(calibData->dig_H2), h3 = vdupq_n_s32(calibData->dig_H3);
+	const uint32x4_t h4 = vdupq_n_u32((uint32_t)(int32_t)calibData->dig_H4 << 20);
+	const int32x4_t h5 = vdupq_n_s32(calibData->dig_H5), h6 = vdupq_n_s32(calibData->dig_H6);
+	const int32x4_t c76800 = vdupq_n_s32(76800), c32768 = vdupq_n_s32(32768);
+	const int32x4_t c2097152 = vdupq_n_s32(2097152), c8192 = vdupq_n_s32(8192);
+	const uint32x4_t c16384 = vdupq_n_u32(16384);
+	const int32x4_t zero = vdupq_n_s32(0), hMax = vdupq_n_s32(H_MAX);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32x4_t raw = vld1q_u32(raw_h + i);
+		int32x4_t v = vsubq_s32(vld1q_s32(t_fine + i), c76800);
+		//unsigned part: ((raw << 14) - (H4 << 20) - H5 * v + 16384) >> 15
+		uint32x4_t x = vsubq_u32(vsubq_u32(vshlq_n_u32(raw, 14), h4), vreinterpretq_u32_s32(vmulq_s32(h5, v)));
+		x = vshrq_n_u32(vaddq_u32(x, c16384), 15);
+		//signed part: ((((v * H6 >> 10) * ((v * H3 >> 11) + 32768) >> 10) + 2097152) * H2 + 8192) >> 14
+		int32x4_t a = vshrq_n_s32(vmulq_s32(v, h6), 10);
+		int32x4_t b = vaddq_s32(vshrq_n_s32(vmulq_s32(v, h3), 11), c32768);
+		int32x4_t y = vaddq_s32(vshrq_n_s32(vmulq_s32(a, b), 10), c2097152);
+		y = vshrq_n_s32(vaddq_s32(vmulq_s32(y, h2), c8192), 14);
+		v = vreinterpretq_s32_u32(vmulq_u32(x, vreinterpretq_u32_s32(y)));
+		int32x4_t s = vshrq_n_s32(v, 15);
+		s = vshrq_n_s32(vmulq_s32(vshrq_n_s32(vmulq_s32(s, s), 7), h1), 4);
+		v = vsubq_s32(v, s);
+		v = vminq_s32(vmaxq_s32(v, zero), hMax);
+		vst1q_u32(h + i, vshrq_n_u32(vreinterpretq_u32_s32(v), 12));
+	}
+	return i;
+}
+#endif
+
+static int resolveBatchImpl() {
+	if (batchImpl != BATCH_IMPL_AUTO) return batchImpl;
+#ifdef BATCH_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) return batchImpl = BATCH_IMPL_AVX2;
+#endif
+#ifdef BATCH_HAVE_NEON
+	return batchImpl = BATCH_IMPL_NEON;
+#endif
+	return batchImpl = BATCH_IMPL_SCALAR;
+}
+
+bool setBatchImpl(int impl) {
+	switch (impl) {
+	case BATCH_IMPL_AUTO:
+	case BATCH_IMPL_SCALAR:
+		break;
+#ifdef BATCH_HAVE_AVX2
+	case BATCH_IMPL_AVX2:
+		if (!__builtin_cpu_supports("avx2")) return false;
+		break;
+#endif
+#ifdef BATCH_HAVE_NEON
+	case BATCH_IMPL_NEON:
+		break;
+#endif
+	default:
+		return false;
+	}
+	batchImpl = impl;
+	return true;
+}
+
+const char * getBatchImpl() {
+	switch (resolveBatchImpl()) {
+	case BATCH_IMPL_AVX2: return "avx2";
+	case BATCH_IMPL_NEON: return "neon";
+	default: return "scalar";
+	}
+}
+
+void compensateBatchT(const struct CalibData * calibData, const uint32_t * raw_t, int32_t * t, int32_t * t_fine, size_t n) {
+	size_t i = 0;
+	switch (resolveBatchImpl()) {
+#ifdef BATCH_HAVE_AVX2
+	case BATCH_IMPL_AVX2: i = compensateBatchTAvx2(calibData, raw_t, t, t_fine, n); break;
+#endif
+#ifdef BATCH_HAVE_NEON
+	case BATCH_IMPL_NEON: i = compensateBatchTNeon(calibData, raw_t, t, t_fine, n); break;
+#endif
+	}
+	for (; i < n; i++) t[i] = compensateTScalar(calibData, raw_t[i], &t_fine[i]);
+}
+
+void compensateBatchP(const struct CalibData * calibData, const uint32_t * raw_p, const int32_t * t_fine, uint32_t * p, size_t n) {
+	size_t i;
+	for (i = 0; i < n; i++) p[i] = compensatePScalar(calibData, raw_p[i], t_fine[i]);
+}
+
+void compensateBatchH(const struct CalibData * calibData, const uint32_t * raw_h, const int32_t * t_fine, uint32_t * h, size_t n) {
+	size_t i = 0;
+	switch (resolveBatchImpl()) {
+#ifdef BATCH_HAVE_AVX2
+	case BATCH_IMPL_AVX2: i = compensateBatchHAvx2(calibData, raw_h, t_fine, h, n); break;
+#endif
+#ifdef BATCH_HAVE_NEON
+	case BATCH_IMPL_NEON: i = compensateBatchHNeon(calibData, raw_h, t_fine, h, n); break;
+#endif
+	}
+	for (; i < n; i++) h[i] = compensateHScalar(calibData, raw_h[i], t_fine[i]);
+}
+
+void compensateBatch(const struct CalibData * calibData, const uint32_t * raw_t, const uint32_t * raw_p, const uint32_t * raw_h,
+	int32_t * t, uint32_t * p, uint32_t * h, int32_t * t_fine, size_t n) {
+	compensateBatchT(calibData, raw_t, t, t_fine, n);
+	compensateBatchP(calibData, raw_p, t_fine, p, n);
+	compensateBatchH(calibData, raw_h, t_fine, h, n);
+}
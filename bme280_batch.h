@@ -0,0 +1,33 @@
+//Batch compensation of raw samples for bulk reprocessing
+//Buffers are struct-of-arrays: raw_t[i], raw_p[i] and raw_h[i] are one sample, as in struct UncompData.
+//Results are bit-identical to compensateT(), compensateP() and compensateH() in bme280_core.h on every code path.
+//Temperature and humidity use AVX2 on x86 (selected at run time) or NEON on ARM, pressure needs 64-bit
+//multiplication and division that neither has, so it is scalar.
+
+#ifndef BME280_BATCH_H
+#define BME280_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bme280.h"
+
+#define BATCH_IMPL_AUTO 0 //fastest available
+#define BATCH_IMPL_SCALAR 1 //reference
+#define BATCH_IMPL_AVX2 2
+#define BATCH_IMPL_NEON 3
+
+//selects the implementation, returns false if it is not available on this CPU or build
+bool setBatchImpl(int impl);
+const char * getBatchImpl();
+
+//t_fine[i] receives fine temperature needed by compensateBatchP() and compensateBatchH()
+void compensateBatchT(const struct CalibData * calibData, const uint32_t * raw_t, int32_t * t, int32_t * t_fine, size_t n);
+void compensateBatchP(const struct CalibData * calibData, const uint32_t * raw_p, const int32_t * t_fine, uint32_t * p, size_t n);
+void compensateBatchH(const struct CalibData * calibData, const uint32_t * raw_h, const int32_t * t_fine, uint32_t * h, size_t n);
+
+//all three channels, t_fine is caller provided scratch space of n elements
+void compensateBatch(const struct CalibData * calibData, const uint32_t * raw_t, const uint32_t * raw_p, const uint32_t * raw_h,
+	int32_t * t, uint32_t * p, uint32_t * h, int32_t * t_fine, size_t n);
+
+#endif
@@ -0,0 +1,109 @@
+//Raw register capture file, see bme280_capture.h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bme280_capture.h"
+
+static void putLe(uint8_t * p, uint64_t v, int len) {
+	for (int i = 0; i < len; i++) p[i] = v >> (8 * i);
+}
+
+static uint64_t getLe(const uint8_t * p, int len) {
+	uint64_t v = 0;
+	for (int i = 0; i < len; i++) v |= (uint64_t)p[i] << (8 * i);
+	return v;
+}
+
+bool openCapture(struct Capture * c, const char * path, bool write) {
+	uint8_t hdr[8];
+	memset(c, 0, sizeof(struct Capture));
+	c->f = fopen(path, write ? "a+b" : "rb");
+	if (!c->f) {
+		perror("Unable to open capture");
+		return false;
+	}
+	//"a+" reads from the start and appends at the end
+	size_t n = fread(hdr, 1, sizeof(hdr), c->f);
+	if (write) fseek(c->f, 0, SEEK_END);
+	if (write && n == 0) {
+		putLe(hdr, CAPTURE_MAGIC, 4);
+		putLe(hdr + 4, CAPTURE_VERSION, 4);
+		if (fwrite(hdr, sizeof(hdr), 1, c->f) == 1) return true;
+		perror("Unable to write capture");
+	} else if (n != sizeof(hdr) || getLe(hdr, 4) != CAPTURE_MAGIC || getLe(hdr + 4, 4) != CAPTURE_VERSION)
+		printf("error: %s is not a bme280 version %d capture\n", path, CAPTURE_VERSION);
+	else return true;
+	fclose(c->f);
+	c->f = NULL;
+	return false;
+}
+
+void closeCapture(struct Capture * c) {
+	if (c->f) fclose(c->f);
+	c->f = NULL;
+}
+
+bool writeCaptureDevice(struct Capture * c, const struct CaptureDevice * dev) {
+	uint8_t rec[2 + sizeof(dev->bus) + 1 + sizeof(dev->regs) + CAPTURE_CALIB_LEN];
+	rec[0] = CAPTURE_DEVICE;
+	rec[1] = dev->id;
+	memcpy(rec + 2, dev->bus, sizeof(dev->bus));
+	rec[2 + sizeof(dev->bus)] = dev->addr;
+	memcpy(rec + 3 + sizeof(dev->bus), dev->regs, sizeof(dev->regs));
+	memcpy(rec + 3 + sizeof(dev->bus) + sizeof(dev->regs), dev->calib, CAPTURE_CALIB_LEN);
+	return fwrite(rec, sizeof(rec), 1, c->f) == 1;
+}
+
+bool writeCaptureSample(struct Capture * c, uint8_t id, int64_t time_ns, const uint8_t * regData) {
+	uint8_t rec[6 + BME280_P_T_H_DATA_LEN];
+	int64_t delta_us = (time_ns - c->time_ns) / 1000;
+	if (!c->timed || delta_us < 0 || delta_us > UINT32_MAX) {
+		uint8_t t[9];
+		t[0] = CAPTURE_TIME;
+		putLe(t + 1, time_ns, 8);
+		if (fwrite(t, sizeof(t), 1, c->f) != 1) return false;
+		c->time_ns = time_ns;
+		c->timed = true;
+		delta_us = 0;
+	}
+	//later deltas are relative to the time replay sees, so rounding does not accumulate
+	c->time_ns += delta_us * 1000;
+	rec[0] = CAPTURE_SAMPLE;
+	rec[1] = id;
+	putLe(rec + 2, delta_us, 4);
+	memcpy(rec + 6, regData, BME280_P_T_H_DATA_LEN);
+	return fwrite(rec, sizeof(rec), 1, c->f) == 1;
+}
+
+int readCapture(struct Capture * c, struct CaptureRecord * rec) {
+	uint8_t buf[2 + sizeof(rec->device.bus) + 1 + sizeof(rec->device.regs) + CAPTURE_CALIB_LEN];
+	int type = fgetc(c->f);
+	if (type == EOF) return 0;
+	rec->type = type;
+	switch (type) {
+	case CAPTURE_TIME:
+		if (fread(buf, 8, 1, c->f) != 1) return 0;
+		c->time_ns = rec->time_ns = getLe(buf, 8);
+		c->timed = true;
+		return 1;
+	case CAPTURE_DEVICE:
+		if (fread(buf + 1, sizeof(buf) - 1, 1, c->f) != 1) return 0;
+		rec->device.id = buf[1];
+		memcpy(rec->device.bus, buf + 2, sizeof(rec->device.bus));
+		rec->device.bus[sizeof(rec->device.bus) - 1] = 0;
+		rec->device.addr = buf[2 + sizeof(rec->device.bus)];
+		memcpy(rec->device.regs, buf + 3 + sizeof(rec->device.bus), sizeof(rec->device.regs));
+		memcpy(rec->device.calib, buf + 3 + sizeof(rec->device.bus) + sizeof(rec->device.regs), CAPTURE_CALIB_LEN);
+		return 1;
+	case CAPTURE_SAMPLE:
+		if (fread(buf + 1, 5 + BME280_P_T_H_DATA_LEN, 1, c->f) != 1) return 0;
+		rec->id = buf[1];
+		c->time_ns += getLe(buf + 2, 4) * 1000;
+		rec->time_ns = c->time_ns;
+		memcpy(rec->regData, buf + 6, BME280_P_T_H_DATA_LEN);
+		return 1;
+	}
+	return -1;
+}
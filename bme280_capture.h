@@ -0,0 +1,61 @@
+//Raw register capture written by "bme280 --capture <file>" and read back by "bme280 --replay <file>"
+//An append-only stream of little-endian records after an 8 byte file header ("BE2R", version), each run appends:
+//a time record: type 1, int64 CLOCK_REALTIME ns, the base of the sample times that follow
+//a device record per sensor before its first sample and after its settings change: type 2, id (index in the run),
+//  bus name (16 bytes), address, ctrl_hum, status, ctrl_meas and config, the 26 + 7 calibration bytes from 0x88 and 0xE1
+//a sample record per burst read: type 3, id, uint32 us since the previous time, the 8 data registers from 0xF7
+//A sample takes 14 bytes. A gap longer than a uint32 of us starts with a time record. Replay compensates the bursts with
+//the recorded calibration and settings, exactly as they were when read, and a run cut short leaves at most a partial last record.
+
+#ifndef BME280_CAPTURE_H
+#define BME280_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bme280.h"
+
+#define CAPTURE_MAGIC 0x52324542 //"BE2R"
+#define CAPTURE_VERSION 1
+#define CAPTURE_CALIB_LEN (BME280_TEMP_PRESS_CALIB_DATA_LEN + BME280_HUMIDITY_CALIB_DATA_LEN)
+
+#define CAPTURE_TIME 1
+#define CAPTURE_DEVICE 2
+#define CAPTURE_SAMPLE 3
+
+struct CaptureDevice
+{
+	uint8_t id;
+	char bus[16];
+	uint8_t addr;
+	uint8_t regs[4]; //ctrl_hum, status, ctrl_meas and config
+	uint8_t calib[CAPTURE_CALIB_LEN];
+};
+
+struct CaptureRecord
+{
+	uint8_t type; //CAPTURE_*
+	int64_t time_ns; //of time and sample records
+	struct CaptureDevice device; //of a device record
+	uint8_t id; //of a sample record
+	uint8_t regData[BME280_P_T_H_DATA_LEN];
+};
+
+struct Capture
+{
+	FILE * f;
+	int64_t time_ns; //time the next sample delta is relative to
+	bool timed; //a time record has been written or read
+};
+
+//opens path for appending or for reading, prints the error and returns false if it is not a capture file
+bool openCapture(struct Capture * c, const char * path, bool write);
+void closeCapture(struct Capture * c);
+
+bool writeCaptureDevice(struct Capture * c, const struct CaptureDevice * dev);
+bool writeCaptureSample(struct Capture * c, uint8_t id, int64_t time_ns, const uint8_t * regData);
+
+//returns 1 with the next record, 0 at the end and -1 on an unknown record type
+int readCapture(struct Capture * c, struct CaptureRecord * rec);
+
+#endif
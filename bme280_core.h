@@ -0,0 +1,303 @@
+//Portable BME280 driver core shared by the linux tool (bme280.c), the Arduino sketch (bme280.ino) and the batch kernels
+//Header only and plain C that also compiles as C++, everything is static inline, so a build keeps only what it calls.
+//
+//It is specialized at compile time by macros defined before it is included:
+//BME280_CORE_CHANNELS  channels compiled in, BME280_ALL by default. Leaving out BME280_PRESS drops the 64-bit
+//                      pressure compensation, leaving out BME280_HUM the humidity one, their calibration and data
+//                      registers are then not read either, which matters on AVR.
+//BME280_CORE_DEV       type of the first argument of the transport, i.e. struct Device * or an i2c address
+//BME280_CORE_READ      int read(BME280_CORE_DEV dev, addr, uint8_t * buf, len), returns the number of registers read
+//BME280_CORE_WRITE     int write(BME280_CORE_DEV dev, addr, uint8_t val), returns 0 on success
+//BME280_CORE_WRITE_REGS optional int write(BME280_CORE_DEV dev, const uint8_t * regs, uint8_t n), writes n address and
+//                      value pairs in order in one transaction (SPI), returns 0 on success, writeSettings() then takes one
+//Without BME280_CORE_READ only the transport independent part is available: parsing, compensation and timing.
+//The core does not print, functions return false on a failed transaction and the caller reports it.
+
+#ifndef BME280_CORE_H
+#define BME280_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "bme280.h"
+
+#ifndef BME280_CORE_CHANNELS
+#define BME280_CORE_CHANNELS BME280_ALL
+#endif
+
+//data registers read by readData(): pressure 0xF7-0xF9, temperature 0xFA-0xFC and humidity 0xFD-0xFE, as offsets from 0xF7
+#if BME280_CORE_CHANNELS & BME280_PRESS
+#define BME280_CORE_DATA_FIRST 0
+#else
+#define BME280_CORE_DATA_FIRST 3
+#endif
+#if BME280_CORE_CHANNELS & BME280_HUM
+#define BME280_CORE_DATA_END BME280_P_T_H_DATA_LEN
+#else
+#define BME280_CORE_DATA_END 6
+#endif
+
+//calibration bytes read from 0x88, dig_H1 is the last of them
+#if BME280_CORE_CHANNELS & (BME280_PRESS | BME280_HUM)
+#define BME280_CORE_CALIB_LEN BME280_TEMP_PRESS_CALIB_DATA_LEN
+#else
+#define BME280_CORE_CALIB_LEN 6
+#endif
+
+static inline void parseSettings(const uint8_t * regData, struct Settings * sets) {
+	sets->osr_h = regData[0] & BME280_CTRL_HUM_MSK;
+	sets->osr_p = (regData[2] & BME280_CTRL_PRESS_MSK) >> BME280_CTRL_PRESS_POS;
+	sets->osr_t = (regData[2] & BME280_CTRL_TEMP_MSK) >> BME280_CTRL_TEMP_POS;
+	sets->filter = (regData[3] & BME280_FILTER_MSK) >> BME280_FILTER_POS;
+	sets->standby_time = (regData[3] & BME280_STANDBY_MSK) >> BME280_STANDBY_POS;
+}
+
+//oversampling register value to number of samples: skipped, 1, 2, 4, 8, 16 (and 16 for all the other values)
+static inline uint8_t getOversampling(uint8_t osr) {
+	if (osr == BME280_NO_OVERSAMPLING) return 0;
+	if (osr > BME280_OVERSAMPLING_16X) osr = BME280_OVERSAMPLING_16X;
+	return 1 << (osr - 1);
+}
+
+//maximum measurement time in us from datasheet, appendix B:
+//t_measure_max = 1.25 + 2.3 * osr_t + (2.3 * osr_p + 0.575) + (2.3 * osr_h + 0.575) ms, skipped measurements take no time
+static inline uint32_t getMeasurementTimeUs(const struct Settings * sets) {
+	uint32_t t = 1250 + 2300 * (uint32_t)getOversampling(sets->osr_t);
+	if (sets->osr_p != BME280_NO_OVERSAMPLING) t += 2300 * (uint32_t)getOversampling(sets->osr_p) + 575;
+	if (sets->osr_h != BME280_NO_OVERSAMPLING) t += 2300 * (uint32_t)getOversampling(sets->osr_h) + 575;
+	return t;
+}
+
+//typical measurement time in us from datasheet, appendix B:
+//t_measure_typ = 1 + 2 * osr_t + (2 * osr_p + 0.5) + (2 * osr_h + 0.5) ms
+static inline uint32_t getMeasurementTimeTypUs(const struct Settings * sets) {
+	uint32_t t = 1000 + 2000 * (uint32_t)getOversampling(sets->osr_t);
+	if (sets->osr_p != BME280_NO_OVERSAMPLING) t += 2000 * (uint32_t)getOversampling(sets->osr_p) + 500;
+	if (sets->osr_h != BME280_NO_OVERSAMPLING) t += 2000 * (uint32_t)getOversampling(sets->osr_h) + 500;
+	return t;
+}
+
+//standby time register value to us
+static inline uint32_t getStandbyTimeUs(uint8_t standby_time) {
+	static const uint32_t t[8] = { 500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000 };
+	return t[standby_time & 7];
+}
+
+//in NORMAL_MODE a new sample is available at most once per this period
+static inline uint32_t getOutputPeriodUs(const struct Settings * sets) {
+	return getMeasurementTimeUs(sets) + getStandbyTimeUs(sets->standby_time);
+}
+
+//channels measured with sets and compiled in, temperature always is as pressure and humidity are compensated with it
+static inline uint8_t getDataType(const struct Settings * sets) {
+	uint8_t dataType = BME280_TEMP;
+	if (sets->osr_p != BME280_NO_OVERSAMPLING) dataType |= BME280_PRESS;
+	if (sets->osr_h != BME280_NO_OVERSAMPLING) dataType |= BME280_HUM;
+	return dataType & BME280_CORE_CHANNELS;
+}
+
+static inline void parseData(const uint8_t * regData, struct UncompData * data) {
+	data->p = ((uint32_t)regData[0] << 12) | ((uint32_t)regData[1] << 4) | ((uint32_t)regData[2] >> 4);
+	data->t = ((uint32_t)regData[3] << 12) | ((uint32_t)regData[4] << 4) | ((uint32_t)regData[5] >> 4);
+	data->h = ((uint32_t)regData[6] << 8) | (uint32_t)regData[7];
+}
+
+//register image of one sample, the inverse of parseData()
+static inline void encodeData(const struct UncompData * data, uint8_t * regData) {
+	regData[0] = data->p >> 12;
+	regData[1] = data->p >> 4;
+	regData[2] = data->p << 4;
+	regData[3] = data->t >> 12;
+	regData[4] = data->t >> 4;
+	regData[5] = data->t << 4;
+	regData[6] = data->h >> 8;
+	regData[7] = data->h;
+}
+
+//a burst of all ones (SDA stuck high, sensor gone) or all zeros (SDA stuck low) or an enabled channel still holding
+//its reset value 0x80000 (0x8000 for humidity), which means the sensor has not measured it, are no measurement
+static inline bool isCorrupt(const struct Settings * sets, const uint8_t * regData, const struct UncompData * data) {
+	bool ones = true, zeros = true;
+	for (int i = BME280_CORE_DATA_FIRST; i < BME280_CORE_DATA_END; i++) {
+		ones &= regData[i] == 0xFF;
+		zeros &= regData[i] == 0;
+	}
+	if (ones || zeros) return true;
+	uint8_t dataType = getDataType(sets);
+	return data->t == 0x80000 || ((dataType & BME280_PRESS) && data->p == 0x80000) || ((dataType & BME280_HUM) && data->h == 0x8000);
+}
+
+//t_fine carries fine temperature to compensateP() and compensateH()
+static inline int32_t compensateT(const struct UncompData * data, const struct CalibData * calibData, int32_t * t_fine) {
+	int32_t t = 0, var1, var2, t_min = -4000, t_max = 8500;
+	var1 = ((((data->t >> 3) - ((int32_t)calibData->dig_T1 << 1))) * ((int32_t)calibData->dig_T2)) >> 11;
+	var2 = (((((data->t >> 4) - ((int32_t)calibData->dig_T1)) * ((data->t >> 4) - ((int32_t)calibData->dig_T1))) >> 12) * ((int32_t)calibData->dig_T3)) >> 14;
+	*t_fine = var1 + var2;
+	t = (*t_fine * 5 + 128) >> 8;
+	if (t < t_min) t = t_min;
+	else if (t > t_max) t = t_max;
+
+	//printf("compensateT: var1 = %ld, var2 = %ld, t = %ld\n", var1, var2, t);
+
+	return t; // t x 10^2 deg C
+}
+
+static inline uint32_t compensateH(const struct UncompData * data, const struct CalibData * calibData, int32_t t_fine) {
+	int32_t h;
+
+	h = t_fine - ((int32_t)76800L);
+	h = (((((data->h << 14) - (((int32_t)calibData->dig_H4) << 20) - (((int32_t)calibData->dig_H5) * h)) + ((int32_t)16384L)) >> 15) * (((((((h * ((int32_t)calibData->dig_H6)) >> 10) * (((h * ((int32_t)calibData->dig_H3)) >> 11) + ((int32_t)32768L))) >> 10) + ((int32_t)2097152L)) * ((int32_t)calibData->dig_H2) + 8192) >> 14));
+	h = (h - (((((h >> 15) * (h >> 15)) >> 7) * ((int32_t)calibData->dig_H1)) >> 4));
+	h = h < 0 ? 0 : h;
+	h = h > 419430400L ? 419430400L : h;
+
+	//printf("compensateH: h = %ld\n", h);
+
+	return (uint32_t)(h >> 12); //in Q22.10 format (22 integer and 10 fractional bits) %RH = %RF / 1024.0
+}
+
+static inline uint32_t compensateP(const struct UncompData * data, const struct CalibData * calibData, int32_t t_fine) {
+	int64_t var1, var2, p;
+
+	var1 = ((int64_t)t_fine) - 128000L;
+	var2 = var1 * var1 * (int64_t)calibData->dig_P6;
+	var2 = var2 + ((var1 * (int64_t)calibData->dig_P5) << 17);
+	var2 = var2 + (((int64_t)calibData->dig_P4) << 35);
+	var1 = ((var1 * var1 * (int64_t)calibData->dig_P3) >> 8) + ((var1 * (int64_t)calibData->dig_P2) << 12);
+	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calibData->dig_P1) >> 33;
+
+	if (var1 == 0) return 0;
+	p = 1048576L - (int32_t)(data->p);
+	p = (((p << 31) - var2) * 3125) / var1;
+	var1 = (((int64_t)calibData->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (((int64_t)calibData->dig_P8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((int64_t)calibData->dig_P7) << 4);
+
+	//printf("compensateP: var1 = %lld, var2 = %lld, p = %ld\n", var1, var2, (uint32_t)p);
+
+	return (uint32_t)p; // in Q24.8 format (24 integer and 8 fractional bits) in Pa; p = p / 256 Pa
+}
+
+//channels not compiled in are never compensated, whatever dataType asks for
+static inline void compensateData(uint8_t dataType, const struct UncompData * uncompData, struct Data * data, const struct CalibData * calibData) {
+	int32_t t_fine = 0;
+	dataType &= BME280_CORE_CHANNELS | BME280_TEMP;
+	if (dataType & (BME280_PRESS | BME280_TEMP | BME280_HUM)) data->t = compensateT(uncompData, calibData, &t_fine);
+#if BME280_CORE_CHANNELS & BME280_PRESS
+	if (dataType & BME280_PRESS) data->p = compensateP(uncompData, calibData, t_fine);
+#endif
+#if BME280_CORE_CHANNELS & BME280_HUM
+	if (dataType & BME280_HUM) data->h = compensateH(uncompData, calibData, t_fine);
+#endif
+}
+
+static inline void parseTempPresCalibData(const uint8_t * data, struct CalibData * calibData) {
+	calibData->dig_T1 = ((uint16_t)data[1] << 8) | (uint16_t)data[0];
+	calibData->dig_T2 = ((int16_t)data[3] << 8) | (int16_t)data[2];
+	calibData->dig_T3 = ((int16_t)data[5] << 8) | (uint16_t)data[4];
+	calibData->dig_P1 = ((uint16_t)data[7] << 8) | (uint16_t)data[6];
+	calibData->dig_P2 = ((int16_t)data[9] << 8) | (uint16_t)data[8];
+	calibData->dig_P3 = ((int16_t)data[11] << 8) | (uint16_t)data[10];
+	calibData->dig_P4 = ((int16_t)data[13] << 8) | (uint16_t)data[12];
+	calibData->dig_P5 = ((int16_t)data[15] << 8) | (uint16_t)data[14];
+	calibData->dig_P6 = ((int16_t)data[17] << 8) | (uint16_t)data[16];
+	calibData->dig_P7 = ((int16_t)data[19] << 8) | (uint16_t)data[18];
+	calibData->dig_P8 = ((int16_t)data[21] << 8) | (uint16_t)data[20];
+	calibData->dig_P9 = ((int16_t)data[23] << 8) | (uint16_t)data[22];
+	calibData->dig_H1 = data[25];
+
+	//printf("t1 = %u, t2 = %d, t3 = %d\n", calibData->dig_T1, calibData->dig_T2, calibData->dig_T3);
+	//printf("p1 = %u, p2 = %d, p3 = %d, p4 = %d, p5 = %d, p6 = %d, p7 = %d, p8 = %d, p9 = %d\n", calibData->dig_P1, calibData->dig_P2, calibData->dig_P3, calibData->dig_P4, calibData->dig_P5, calibData->dig_P6, calibData->dig_P7, calibData->dig_P8, calibData->dig_P9);
+}
+
+static inline void parseHumidCalibData(const uint8_t * data, struct CalibData * calibData) {
+	calibData->dig_H2 = ((int16_t)data[1] << 8) | (int16_t)data[0];
+	calibData->dig_H3 = data[2];
+	calibData->dig_H4 = (((int16_t)((int8_t)data[3])) << 4) | (((int16_t)data[4]) & 0xF);
+	calibData->dig_H5 = (((int16_t)((int8_t)data[5])) << 4) | ((int16_t)(data[4] >> 4) & 0xF);
+	calibData->dig_H6 = (int8_t)data[6];
+
+	//printf("h1 = %u, h2 = %d, h3 = %u, h4 = %d, h5 = %d, h6 = %d\n", calibData->dig_H1, calibData->dig_H2, calibData->dig_H3, calibData->dig_H4, calibData->dig_H5, calibData->dig_H6);
+}
+
+#ifdef BME280_CORE_READ
+
+//reads and parses the calibration of the channels compiled in
+static inline bool readCalibData(BME280_CORE_DEV dev, struct CalibData * calibData) {
+	uint8_t cData[BME280_TEMP_PRESS_CALIB_DATA_LEN];
+	memset(cData, 0, sizeof(cData));
+	if (BME280_CORE_READ(dev, BME280_TEMP_PRESS_CALIB_DATA_ADDR, cData, BME280_CORE_CALIB_LEN) != BME280_CORE_CALIB_LEN) return false;
+	parseTempPresCalibData(cData, calibData);
+#if BME280_CORE_CHANNELS & BME280_HUM
+	if (BME280_CORE_READ(dev, BME280_HUMIDITY_CALIB_DATA_ADDR, cData, BME280_HUMIDITY_CALIB_DATA_LEN) != BME280_HUMIDITY_CALIB_DATA_LEN) return false;
+	parseHumidCalibData(cData, calibData);
+#endif
+	return true;
+}
+
+//reads the data registers of the channels compiled in with one burst, so they come from the same measurement,
+//regData receives the BME280_P_T_H_DATA_LEN registers from 0xF7, those not read are zero
+static inline bool readData(BME280_CORE_DEV dev, uint8_t * regData, struct UncompData * data) {
+	memset(regData, 0, BME280_P_T_H_DATA_LEN);
+	if (BME280_CORE_READ(dev, BME280_DATA_ADDR + BME280_CORE_DATA_FIRST, regData + BME280_CORE_DATA_FIRST, BME280_CORE_DATA_END - BME280_CORE_DATA_FIRST) != BME280_CORE_DATA_END - BME280_CORE_DATA_FIRST) return false;
+	parseData(regData, data);
+	return true;
+}
+
+//writes register BME280_CTRL_HUM_ADDR + i and its shadow copy
+static inline bool writeShadowReg(BME280_CORE_DEV dev, uint8_t * regs, int i, uint8_t val) {
+	if (BME280_CORE_WRITE(dev, BME280_CTRL_HUM_ADDR + i, val) != 0) return false;
+	regs[i] = val;
+	return true;
+}
+
+//writes n address and value pairs of registers from BME280_CTRL_HUM_ADDR on and their shadow copies
+static inline bool writeShadowRegs(BME280_CORE_DEV dev, uint8_t * regs, const uint8_t * pairs, int n) {
+#ifdef BME280_CORE_WRITE_REGS
+	if (n == 0) return true;
+	if (BME280_CORE_WRITE_REGS(dev, pairs, n) != 0) return false;
+	for (int i = 0; i < n; i++) regs[pairs[2 * i] - BME280_CTRL_HUM_ADDR] = pairs[2 * i + 1];
+#else
+	for (int i = 0; i < n; i++)
+		if (!writeShadowReg(dev, regs, pairs[2 * i] - BME280_CTRL_HUM_ADDR, pairs[2 * i + 1])) return false;
+#endif
+	return true;
+}
+
+//brings ctrl_hum, ctrl_meas and config to sets and mode with the fewest writes, comparing with the shadow copy of
+//ctrl_hum, status, ctrl_meas and config in regs instead of reading the registers back. config writes may be ignored
+//outside SLEEP_MODE, so a running sensor is put to sleep first with one ctrl_meas write, no soft reset is needed.
+//A changed ctrl_hum takes effect on the next ctrl_meas write.
+//at most four writes: sleep, ctrl_hum, config and ctrl_meas, a change of oversampling in NORMAL_MODE is one write,
+//with BME280_CORE_WRITE_REGS they are one transaction
+//returns false on a failed write, regs no longer match the sensor then
+static inline bool writeSettings(BME280_CORE_DEV dev, uint8_t * regs, const struct Settings * sets, uint8_t mode) {
+	uint8_t ctrl_hum = (regs[0] & ~BME280_CTRL_HUM_MSK) | (sets->osr_h & BME280_CTRL_HUM_MSK);
+	uint8_t ctrl_meas = ((sets->osr_p << BME280_CTRL_PRESS_POS) & BME280_CTRL_PRESS_MSK) | ((sets->osr_t << BME280_CTRL_TEMP_POS) & BME280_CTRL_TEMP_MSK) | (mode & BME280_SENSOR_MODE_MSK);
+	//spi3w_en is kept
+	uint8_t config = (regs[3] & ~(BME280_FILTER_MSK | BME280_STANDBY_MSK)) | ((sets->filter << BME280_FILTER_POS) & BME280_FILTER_MSK) | ((sets->standby_time << BME280_STANDBY_POS) & BME280_STANDBY_MSK);
+	bool hum = ctrl_hum != regs[0];
+	uint8_t pairs[8];
+	int n = 0;
+	if (config != regs[3]) {
+		if ((regs[2] & BME280_SENSOR_MODE_MSK) != BME280_SLEEP_MODE) {
+			pairs[2 * n] = BME280_CTRL_MEAS_ADDR;
+			pairs[2 * n++ + 1] = regs[2] & ~BME280_SENSOR_MODE_MSK;
+		}
+		pairs[2 * n] = BME280_CONFIG_ADDR;
+		pairs[2 * n++ + 1] = config;
+	}
+	if (hum) {
+		pairs[2 * n] = BME280_CTRL_HUM_ADDR;
+		pairs[2 * n++ + 1] = ctrl_hum;
+	}
+	if (hum || ctrl_meas != (n && pairs[0] == BME280_CTRL_MEAS_ADDR ? pairs[1] : regs[2])) {
+		pairs[2 * n] = BME280_CTRL_MEAS_ADDR;
+		pairs[2 * n++ + 1] = ctrl_meas;
+	}
+	return writeShadowRegs(dev, regs, pairs, n);
+}
+
+#endif
+
+#endif
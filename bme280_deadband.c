@@ -0,0 +1,41 @@
+//Change-driven output, see bme280_deadband.h
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bme280_deadband.h"
+
+bool parseDeadband(const char * spec, struct Deadband * db) {
+	char buf[64], * opt, * saveptr, * end;
+	if (strlen(spec) >= sizeof(buf)) return false;
+	strcpy(buf, spec);
+	db->t = db->p = db->h = 0;
+	for (opt = strtok_r(buf, ",", &saveptr); opt; opt = strtok_r(NULL, ",", &saveptr)) {
+		if (strlen(opt) < 3 || opt[1] != '=') return false;
+		double v = strtod(opt + 2, &end);
+		if (*end || v <= 0) return false;
+		//to the units of struct Data: 0.01 deg C, 1/256 Pa and 1/1024 %RH
+		switch (opt[0]) {
+		case 't': db->t = lround(v * 100); break;
+		case 'p': db->p = lround(v * 25600); break;
+		case 'h': db->h = lround(v * 1024); break;
+		default: return false;
+		}
+	}
+	return db->t || db->p || db->h;
+}
+
+bool passDeadband(const struct Deadband * db, struct DeadbandState * s, uint8_t dataType, int64_t time_ns, const struct Data * data) {
+	bool pass = !s->init || (db->heartbeat_ns && time_ns - s->time_ns >= (int64_t)db->heartbeat_ns) ||
+		(db->t && abs(data->t - s->last.t) >= db->t) ||
+		(db->p && (dataType & BME280_PRESS) && llabs((int64_t)data->p - s->last.p) >= db->p) ||
+		(db->h && (dataType & BME280_HUM) && llabs((int64_t)data->h - s->last.h) >= db->h);
+	if (!pass) return false;
+	s->init = true;
+	s->time_ns = time_ns;
+	s->last = *data;
+	return true;
+}
@@ -0,0 +1,35 @@
+//Change-driven output ("bme280 --deadband", "--heartbeat"): a sample is passed on only if a channel has moved by at least
+//its deadband since the last sample passed, or if the heartbeat has expired since then, so a steady sensor costs
+//one line, log record or push per heartbeat and a consumer never sees a value older than heartbeat plus one interval.
+//Deadbands are given as t=<deg C>,h=<%RH>,p=<hPa>, i.e. "t=0.1,h=0.5,p=0.05", a channel not given never triggers output.
+//Changes are measured from the last sample passed, not the previous one, so a slow drift passes once it adds up.
+
+#ifndef BME280_DEADBAND_H
+#define BME280_DEADBAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+
+struct Deadband
+{
+	int32_t t; //in the units of struct Data, 0 if the channel does not trigger
+	uint32_t p;
+	uint32_t h;
+	uint64_t heartbeat_ns; //0 for none
+};
+
+//per device
+struct DeadbandState
+{
+	bool init;
+	int64_t time_ns; //of the last sample passed
+	struct Data last;
+};
+
+bool parseDeadband(const char * spec, struct Deadband * db);
+
+//returns true if the sample is to be output, it is then the one later samples are compared with
+bool passDeadband(const struct Deadband * db, struct DeadbandState * s, uint8_t dataType, int64_t time_ns, const struct Data * data);
+
+#endif
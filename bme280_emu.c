@@ -0,0 +1,336 @@
+//Software BME280, see bme280_emu.h
+//Measurements are computed lazily: every transaction first brings the model up to the current time, so a model that
+//is not read costs nothing. Data registers are made by inverting the compensation formulas with a binary search over
+//the raw value, so the driver reads back the waveform value to within one LSB.
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bme280_emu.h"
+#include "bme280_batch.h"
+#include "bme280_core.h"
+
+#define RAW_SKIPPED_20 0x80000 //data register value of a skipped temperature or pressure measurement
+#define RAW_SKIPPED_16 0x8000 //and humidity
+
+//of a production sensor, dig_T3 is positive as on most parts: with a negative one the unsigned arithmetic of compensateT()
+//in bme280_core.h makes temperature non-monotonic in raw_t and it cannot be inverted
+static const struct CalibData typicalCalibData = { 28485, 26735, 50, 37165, -10681, 3024, 6937, -107, -7, 9900, -10230, 4285, 75, 353, 0, 340, 0, 30 };
+
+static uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//xorshift32, uniform in [0, 1)
+static double random01(struct Emu * emu) {
+	uint32_t x = emu->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	emu->seed = x;
+	return x / 4294967296.0;
+}
+
+static double getWave(struct Emu * emu, const struct EmuWave * w, uint64_t at_ns) {
+	double v = w->base;
+	if (w->amplitude != 0 && w->period_s > 0) v += w->amplitude * sin(2 * M_PI * (at_ns / 1e9) / w->period_s);
+	if (w->noise != 0) v += (2 * random01(emu) - 1) * w->noise;
+	return v;
+}
+
+//register image of calibration data, the inverse of parseTempPresCalibData() and parseHumidCalibData() in bme280_core.h
+static void encodeCalibData(const struct CalibData * calibData, uint8_t * regs) {
+	uint8_t * tp = &regs[BME280_TEMP_PRESS_CALIB_DATA_ADDR], * h = &regs[BME280_HUMIDITY_CALIB_DATA_ADDR];
+	const uint16_t words[12] = { calibData->dig_T1, calibData->dig_T2, calibData->dig_T3, calibData->dig_P1, calibData->dig_P2, calibData->dig_P3,
+		calibData->dig_P4, calibData->dig_P5, calibData->dig_P6, calibData->dig_P7, calibData->dig_P8, calibData->dig_P9 };
+	for (int i = 0; i < 12; i++) {
+		tp[2 * i] = words[i] & 0xFF;
+		tp[2 * i + 1] = words[i] >> 8;
+	}
+	tp[25] = calibData->dig_H1;
+	h[0] = (uint16_t)calibData->dig_H2 & 0xFF;
+	h[1] = (uint16_t)calibData->dig_H2 >> 8;
+	h[2] = calibData->dig_H3;
+	h[3] = (uint16_t)calibData->dig_H4 >> 4;
+	h[4] = (calibData->dig_H4 & 0xF) | ((calibData->dig_H5 & 0xF) << 4);
+	h[5] = (uint16_t)calibData->dig_H5 >> 4;
+	h[6] = calibData->dig_H6;
+}
+
+static int64_t evalT(const struct CalibData * calibData, uint32_t raw, int32_t t_fine) {
+	int32_t t;
+	compensateBatchT(calibData, &raw, &t, &t_fine, 1);
+	return t;
+}
+
+static int64_t evalP(const struct CalibData * calibData, uint32_t raw, int32_t t_fine) {
+	uint32_t p;
+	compensateBatchP(calibData, &raw, &t_fine, &p, 1);
+	return p;
+}
+
+static int64_t evalH(const struct CalibData * calibData, uint32_t raw, int32_t t_fine) {
+	uint32_t h;
+	compensateBatchH(calibData, &raw, &t_fine, &h, 1);
+	return h;
+}
+
+//raw value in [lo, hi] the compensation maps to target, found by binary search over a monotonic stretch of the formula
+static uint32_t invert(int64_t (*eval)(const struct CalibData *, uint32_t, int32_t), const struct CalibData * calibData, int32_t t_fine,
+	uint32_t lo, uint32_t hi, bool rising, int64_t target) {
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int64_t v = eval(calibData, mid, t_fine);
+		if (rising ? v < target : v > target) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+//osr register value to number of samples, skipped is 0
+static uint32_t getSamples(uint8_t osr) {
+	if (osr == BME280_NO_OVERSAMPLING) return 0;
+	return osr > BME280_OVERSAMPLING_16X ? 16 : 1 << (osr - 1);
+}
+
+//datasheet typical measurement time, appendix B
+static uint64_t getMeasurementNs(const struct Emu * emu) {
+	uint8_t ctrl_meas = emu->regs[BME280_CTRL_MEAS_ADDR];
+	uint32_t osr_t = getSamples((ctrl_meas & BME280_CTRL_TEMP_MSK) >> BME280_CTRL_TEMP_POS);
+	uint32_t osr_p = getSamples((ctrl_meas & BME280_CTRL_PRESS_MSK) >> BME280_CTRL_PRESS_POS);
+	uint32_t osr_h = getSamples(emu->ctrl_hum & BME280_CTRL_HUM_MSK);
+	uint64_t us = 1000 + 2000 * osr_t;
+	if (osr_p) us += 2000 * osr_p + 500;
+	if (osr_h) us += 2000 * osr_h + 500;
+	return us * 1000;
+}
+
+static uint64_t getStandbyNs(const struct Emu * emu) {
+	static const uint32_t us[8] = { 500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000 };
+	return (uint64_t)us[(emu->regs[BME280_CONFIG_ADDR] & BME280_STANDBY_MSK) >> BME280_STANDBY_POS] * 1000;
+}
+
+//IIR filter of the chip on temperature and pressure: data = (old_data * (coeff - 1) + new_data) / coeff
+static uint32_t filter(const struct Emu * emu, uint32_t * state, uint32_t raw) {
+	uint8_t f = (emu->regs[BME280_CONFIG_ADDR] & BME280_FILTER_MSK) >> BME280_FILTER_POS;
+	uint32_t coeff = f == BME280_FILTER_COEFF_OFF ? 1 : f > BME280_FILTER_COEFF_16 ? 16 : 1 << f;
+	*state = *state == 0 ? raw : (*state * (uint64_t)(coeff - 1) + raw) / coeff;
+	return *state;
+}
+
+//one completed measurement at time at_ns
+static void measure(struct Emu * emu, uint64_t at_ns) {
+	uint8_t ctrl_meas = emu->regs[BME280_CTRL_MEAS_ADDR];
+	int32_t t, t_fine;
+	uint32_t raw_t, raw_p, raw_h;
+	int64_t target = llround(getWave(emu, &emu->t, at_ns) * 100);
+	//compensateT() and compensateH() work on the unsigned raw value, below raw_t = 16 * dig_T1 and raw_h = 64 * dig_H4
+	//their first term wraps around, above those they rise with dig_T2 and dig_H2, pressure falls over the whole range
+	raw_t = invert(evalT, &emu->calibData, 0, emu->calibData.dig_T1 * 16, 0xFFFFF, emu->calibData.dig_T2 >= 0, target);
+	compensateBatchT(&emu->calibData, &raw_t, &t, &t_fine, 1);
+	target = llround(getWave(emu, &emu->p, at_ns) * 100 * 256);
+	raw_p = invert(evalP, &emu->calibData, t_fine, 0, 0xFFFFF, false, target);
+	target = llround(getWave(emu, &emu->h, at_ns) * 1024);
+	raw_h = invert(evalH, &emu->calibData, t_fine, emu->calibData.dig_H4 > 0 ? emu->calibData.dig_H4 * 64 : 0, 0xFFFF, emu->calibData.dig_H2 >= 0, target);
+	raw_t = (ctrl_meas & BME280_CTRL_TEMP_MSK) ? filter(emu, &emu->iir_t, raw_t) : RAW_SKIPPED_20;
+	raw_p = (ctrl_meas & BME280_CTRL_PRESS_MSK) ? filter(emu, &emu->iir_p, raw_p) : RAW_SKIPPED_20;
+	raw_h = (emu->ctrl_hum & BME280_CTRL_HUM_MSK) ? raw_h : RAW_SKIPPED_16;
+	struct UncompData data = { raw_p, raw_t, raw_h };
+	encodeData(&data, &emu->regs[BME280_DATA_ADDR]);
+}
+
+//completes measurements due by now and updates the status register
+static void update(struct Emu * emu, uint64_t now) {
+	if (emu->measEnd_ns && now >= emu->measEnd_ns) {
+		if (emu->period_ns) {
+			uint64_t n = (now - emu->measEnd_ns) / emu->period_ns + 1;
+			for (uint64_t i = n > EMU_MAX_CATCHUP ? n - EMU_MAX_CATCHUP : 0; i < n; i++)
+				measure(emu, emu->measEnd_ns + i * emu->period_ns);
+			emu->measStart_ns += n * emu->period_ns;
+			emu->measEnd_ns += n * emu->period_ns;
+		} else {
+			//FORCED_MODE returns to SLEEP_MODE after one measurement
+			measure(emu, emu->measEnd_ns);
+			emu->measEnd_ns = 0;
+			emu->regs[BME280_CTRL_MEAS_ADDR] &= ~BME280_SENSOR_MODE_MSK;
+		}
+	}
+	uint8_t status = 0;
+	if (emu->measEnd_ns && now >= emu->measStart_ns) status |= BME280_STATUS_MEASURING_MSK;
+	if (now < emu->resetDone_ns) status |= BME280_STATUS_IM_UPDATE_MSK;
+	emu->regs[BME280_STATUS_ADDR] = status;
+}
+
+static void reset(struct Emu * emu, uint64_t now) {
+	memset(&emu->regs[BME280_CTRL_HUM_ADDR], 0, BME280_DATA_ADDR - BME280_CTRL_HUM_ADDR);
+	struct UncompData skipped = { RAW_SKIPPED_20, RAW_SKIPPED_20, RAW_SKIPPED_16 };
+	encodeData(&skipped, &emu->regs[BME280_DATA_ADDR]);
+	emu->ctrl_hum = 0;
+	emu->measEnd_ns = emu->period_ns = 0;
+	emu->iir_t = emu->iir_p = 0;
+	emu->resetDone_ns = now + (uint64_t)emu->reset_us * 1000;
+}
+
+void initEmu(struct Emu * emu, const struct CalibData * calibData) {
+	memset(emu, 0, sizeof(struct Emu));
+	emu->calibData = calibData ? *calibData : typicalCalibData;
+	encodeCalibData(&emu->calibData, emu->regs);
+	emu->regs[BME280_CHIP_ID_ADDR] = BME280_CHIP_ID;
+	emu->t.base = 25;
+	emu->p.base = 1013.25;
+	emu->h.base = 50;
+	emu->reset_us = EMU_RESET_US;
+	emu->seed = 1;
+	for (int i = 0; i < 256; i++) emu->stuck[i] = -1;
+	reset(emu, 0);
+}
+
+static bool parseWave(const char * arg, struct EmuWave * w) {
+	double * v[4] = { &w->base, &w->amplitude, &w->period_s, &w->noise };
+	char * end;
+	for (int i = 0; i < 4; i++) {
+		*v[i] = strtod(arg, &end);
+		if (end == arg) return false;
+		if (*end == 0) return true;
+		if (*end != ':') return false;
+		arg = end + 1;
+	}
+	return false;
+}
+
+bool parseEmu(struct Emu * emu, const char * options) {
+	char buf[256], * opt, * saveptr, * end;
+	if (strlen(options) >= sizeof(buf)) return false;
+	strcpy(buf, options);
+	for (opt = strtok_r(buf, ",", &saveptr); opt; opt = strtok_r(NULL, ",", &saveptr)) {
+		char * val = strchr(opt, '=');
+		if (!val) return false;
+		*val++ = 0;
+		if (strcmp(opt, "t") == 0) {
+			if (!parseWave(val, &emu->t)) return false;
+		} else if (strcmp(opt, "p") == 0) {
+			if (!parseWave(val, &emu->p)) return false;
+		} else if (strcmp(opt, "h") == 0) {
+			if (!parseWave(val, &emu->h)) return false;
+		} else if (strcmp(opt, "latency") == 0) {
+			emu->latency_us = strtoul(val, &end, 10);
+			if (*end) return false;
+		} else if (strcmp(opt, "nack") == 0) {
+			emu->nack = strtod(val, &end);
+			if (*end || emu->nack < 0 || emu->nack > 1) return false;
+		} else if (strcmp(opt, "reset") == 0) {
+			emu->reset_us = strtoul(val, &end, 10);
+			if (*end) return false;
+		} else if (strcmp(opt, "seed") == 0) {
+			emu->seed = strtoul(val, &end, 10);
+			if (*end || emu->seed == 0) return false;
+		} else if (strcmp(opt, "stuck") == 0) {
+			unsigned long reg = strtoul(val, &end, 16), v;
+			if (*end != ':' || reg > 0xFF) return false;
+			v = strtoul(end + 1, &end, 16);
+			if (*end || v > 0xFF) return false;
+			emu->stuck[reg] = v;
+		} else
+			return false;
+	}
+	return true;
+}
+
+//latency and NACK of one transaction, returns false if it was not acknowledged
+static bool transact(struct Emu * emu) {
+	if (emu->latency_us) {
+		struct timespec req = { emu->latency_us / 1000000, (emu->latency_us % 1000000) * 1000 };
+		while (clock_nanosleep(CLOCK_MONOTONIC, 0, &req, &req) == EINTR);
+	}
+	if (emu->nack > 0 && random01(emu) < emu->nack) {
+		emu->nacks++;
+		errno = EREMOTEIO;
+		return false;
+	}
+	return true;
+}
+
+int readEmu(struct Emu * emu, uint8_t addr, uint8_t * buf, uint16_t len) {
+	emu->reads++;
+	if (addr + len > 256) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!transact(emu)) return -1;
+	update(emu, nowNs());
+	for (int i = 0; i < len; i++)
+		buf[i] = emu->stuck[addr + i] >= 0 ? emu->stuck[addr + i] : emu->regs[addr + i];
+	emu->bytes += len;
+	return len;
+}
+
+//a register write at time now, the model is up to date
+static void writeReg(struct Emu * emu, uint8_t addr, uint8_t val, uint64_t now) {
+	emu->bytes++;
+	switch (addr) {
+	case BME280_RESET_ADDR:
+		if (val == 0xB6) reset(emu, now);
+		break;
+	case BME280_CTRL_HUM_ADDR:
+		emu->regs[addr] = val & BME280_CTRL_HUM_MSK;
+		break;
+	case BME280_CTRL_MEAS_ADDR:
+		//ctrl_hum takes effect only after ctrl_meas is written
+		emu->regs[addr] = val;
+		emu->ctrl_hum = emu->regs[BME280_CTRL_HUM_ADDR];
+		emu->measStart_ns = now;
+		emu->measEnd_ns = emu->period_ns = 0;
+		if ((val & BME280_SENSOR_MODE_MSK) != BME280_SLEEP_MODE) emu->measEnd_ns = now + getMeasurementNs(emu);
+		if ((val & BME280_SENSOR_MODE_MSK) == BME280_NORMAL_MODE) emu->period_ns = getMeasurementNs(emu) + getStandbyNs(emu);
+		break;
+	case BME280_CONFIG_ADDR:
+		//datasheet 5.4.6: writes to config in NORMAL_MODE may be ignored, the model always ignores them
+		if ((emu->regs[BME280_CTRL_MEAS_ADDR] & BME280_SENSOR_MODE_MSK) != BME280_NORMAL_MODE) emu->regs[addr] = val & ~0x02;
+		break;
+	}
+}
+
+int writeEmu(struct Emu * emu, uint8_t addr, uint8_t val) {
+	emu->writes++;
+	if (!transact(emu)) return -1;
+	uint64_t now = nowNs();
+	update(emu, now);
+	writeReg(emu, addr, val, now);
+	return 0;
+}
+
+//datasheet 6.3: the first byte is a control byte, bit 7 set reads from the register it addresses on, auto-incremented,
+//bit 7 cleared writes the next byte to the register with bit 7 set, further control and data byte pairs may follow
+int transferEmuSpi(struct Emu * emu, const uint8_t * tx, uint8_t * rx, uint16_t len) {
+	if (len < 2 || (!(tx[0] & 0x80) && len % 2) || ((tx[0] & 0x80) && tx[0] + len - 1 > 256)) {
+		errno = EINVAL;
+		return -1;
+	}
+	bool read = tx[0] & 0x80;
+	if (read) emu->reads++;
+	else emu->writes++;
+	//a transfer with a failed transaction reads as all ones, SDO is not driven
+	memset(rx, 0xFF, len);
+	if (!transact(emu)) return -1;
+	uint64_t now = nowNs();
+	update(emu, now);
+	if (read) {
+		for (int i = 1; i < len; i++) rx[i] = emu->stuck[tx[0] + i - 1] >= 0 ? emu->stuck[tx[0] + i - 1] : emu->regs[tx[0] + i - 1];
+		emu->bytes += len - 1;
+		return len;
+	}
+	for (int i = 0; i < len; i += 2) {
+		if (tx[i] & 0x80) {
+			errno = EINVAL;
+			return -1;
+		}
+		writeReg(emu, tx[i] | 0x80, tx[i + 1], now);
+	}
+	return len;
+}
@@ -0,0 +1,67 @@
+//Software model of the BME280 register map, used in place of a sensor on a real bus ("bme280 emu ...", "bme280 emu-spi ...", --bench)
+//It serves chip id, calibration, ctrl/config, reset, status and data registers, runs measurements in SLEEP, FORCED and
+//NORMAL mode on the datasheet typical timing, including the IIR filter, and produces data registers from programmable
+//temperature, pressure and humidity waveforms. Faults can be injected: per-transaction latency, NACKs, stuck registers
+//and a slow reset. Time is CLOCK_MONOTONIC, so the driver's own sleeps and polls see the model advance.
+
+#ifndef BME280_EMU_H
+#define BME280_EMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+
+#define EMU_RESET_US 1000 //NVM copy after a soft reset, im_update is set meanwhile
+#define EMU_MAX_CATCHUP 64 //NORMAL_MODE cycles computed at most when the model was not read for a while
+
+//base + amplitude * sin(2 pi t / period_s) + uniform noise in [-noise, noise]
+struct EmuWave
+{
+	double base;
+	double amplitude;
+	double period_s;
+	double noise;
+};
+
+struct Emu
+{
+	uint8_t regs[256]; //register image as read over the bus
+	struct CalibData calibData;
+	struct EmuWave t; //deg C
+	struct EmuWave p; //hPa
+	struct EmuWave h; //%RH
+	//faults
+	uint32_t latency_us; //added to every transaction
+	double nack; //probability a transaction is not acknowledged
+	uint32_t reset_us; //im_update is set this long after a soft reset
+	int16_t stuck[256]; //value a register always reads as, -1 if it works
+	uint32_t seed;
+	//state
+	uint8_t ctrl_hum; //written value, takes effect on the next ctrl_meas write
+	uint64_t resetDone_ns;
+	uint64_t measStart_ns; //start of the current or last measurement
+	uint64_t measEnd_ns; //data registers are updated then, 0 if none is pending
+	uint64_t period_ns; //NORMAL_MODE cycle, 0 in the other modes
+	uint32_t iir_t, iir_p; //filter state in raw units, 0 after reset
+	//bus statistics
+	uint64_t reads; //transactions
+	uint64_t writes;
+	uint64_t bytes;
+	uint64_t nacks;
+};
+
+//power-on state with the given calibration, or that of a typical sensor if NULL, at 25 deg C, 1013.25 hPa and 50 %RH
+void initEmu(struct Emu * emu, const struct CalibData * calibData);
+
+//comma separated options, i.e. "t=22:3:600,h=45,latency=200,nack=0.01,stuck=f8:00,reset=5000"
+//t, p and h are base[:amplitude[:period_s[:noise]]] in deg C, hPa and %RH, stuck is a hex register and value
+bool parseEmu(struct Emu * emu, const char * options);
+
+//one bus transaction, returns len or -1 with errno set if it was not acknowledged
+int readEmu(struct Emu * emu, uint8_t addr, uint8_t * buf, uint16_t len);
+int writeEmu(struct Emu * emu, uint8_t addr, uint8_t val);
+
+//one SPI transfer of len bytes with CSB held low, a read or a run of writes, returns len or -1 with errno set
+int transferEmuSpi(struct Emu * emu, const uint8_t * tx, uint8_t * rx, uint16_t len);
+
+#endif
@@ -0,0 +1,128 @@
+//Host-side filter chains, see bme280_filter.h
+
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "bme280_filter.h"
+
+static const uint8_t channels[FILTER_CHANNELS] = { BME280_TEMP, BME280_PRESS, BME280_HUM };
+
+static double getValue(const struct Data * data, int c) {
+	return c == 0 ? data->t : c == 1 ? (double)data->p : (double)data->h;
+}
+
+static void setValue(struct Data * data, int c, double v) {
+	if (c == 0) data->t = lround(v);
+	else if (c == 1) data->p = v < 0 ? 0 : lround(v);
+	else data->h = v < 0 ? 0 : lround(v);
+}
+
+static bool parseStage(char * opt, struct FilterStage * stage) {
+	char * val = strchr(opt, ':'), * end;
+	if (val) *val++ = 0;
+	if (strcasecmp(opt, "median") == 0) {
+		long n = val ? strtol(val, &end, 10) : 0;
+		if (!val || *end || n < 3 || n > FILTER_MAX_MEDIAN || n % 2 == 0) {
+			printf("error: median:%s is not an odd length from 3 to %d\n", val ? val : "", FILTER_MAX_MEDIAN);
+			return false;
+		}
+		stage->type = FILTER_MEDIAN;
+		stage->n = n;
+		return true;
+	}
+	if (strcasecmp(opt, "ema") == 0 || strcasecmp(opt, "kalman") == 0) {
+		stage->type = tolower(opt[0]) == 'e' ? FILTER_EMA : FILTER_KALMAN;
+		stage->k = val ? strtod(val, &end) : 0;
+		if (!val || *end || stage->k <= 0 || (stage->type == FILTER_EMA && stage->k > 1)) {
+			printf("error: %s:%s is not %s\n", opt, val ? val : "", stage->type == FILTER_EMA ? "an alpha in (0, 1]" : "a positive noise ratio");
+			return false;
+		}
+		return true;
+	}
+	printf("error: unknown filter %s, it must be ema, median or kalman\n", opt);
+	return false;
+}
+
+bool parseFilterChain(const char * spec, struct FilterChain * chain) {
+	char buf[128], * opt, * saveptr;
+	if (strlen(spec) >= sizeof(buf)) {
+		printf("error: filter %s is too long\n", spec);
+		return false;
+	}
+	strcpy(buf, spec);
+	memset(chain, 0, sizeof(struct FilterChain));
+	for (opt = strtok_r(buf, ",", &saveptr); opt; opt = strtok_r(NULL, ",", &saveptr)) {
+		if (chain->n == FILTER_MAX_STAGES) {
+			printf("error: filter %s has more than %d stages\n", spec, FILTER_MAX_STAGES);
+			return false;
+		}
+		if (!parseStage(opt, &chain->stages[chain->n++])) return false;
+	}
+	if (chain->n == 0) {
+		printf("error: filter is empty\n");
+		return false;
+	}
+	return true;
+}
+
+void initFilter(struct Filter * f, const struct FilterChain * chain) {
+	memset(f, 0, sizeof(struct Filter));
+	f->chain = chain;
+}
+
+//insertion sort of at most FILTER_MAX_MEDIAN values is cheaper than anything clever
+static double getMedian(const struct FilterState * s) {
+	double v[FILTER_MAX_MEDIAN];
+	for (int i = 0; i < s->len; i++) {
+		int j = i;
+		for (; j > 0 && v[j - 1] > s->buf[i]; j--) v[j] = v[j - 1];
+		v[j] = s->buf[i];
+	}
+	return v[s->len / 2];
+}
+
+static double runStage(const struct FilterStage * stage, struct FilterState * s, double x) {
+	switch (stage->type) {
+	case FILTER_EMA:
+		s->y = s->init ? s->y + stage->k * (x - s->y) : x;
+		break;
+	case FILTER_MEDIAN:
+		//until n samples were seen, the median of those there are
+		s->buf[s->pos] = x;
+		s->pos = (s->pos + 1) % stage->n;
+		if (s->len < stage->n) s->len++;
+		s->y = getMedian(s);
+		break;
+	case FILTER_KALMAN:
+		//measurement noise variance is 1, process noise variance k
+		if (!s->init) {
+			s->y = x;
+			s->p = 1;
+		} else {
+			double p = s->p + stage->k, gain = p / (p + 1);
+			s->y += gain * (x - s->y);
+			s->p = (1 - gain) * p;
+		}
+		break;
+	}
+	s->init = true;
+	return s->y;
+}
+
+void applyFilter(struct Filter * f, uint8_t dataType, const struct Data * in, struct Data * out) {
+	*out = *in;
+	for (int c = 0; c < FILTER_CHANNELS; c++) {
+		if (!(dataType & channels[c])) {
+			memset(f->state[c], 0, sizeof(f->state[c]));
+			continue;
+		}
+		double v = getValue(in, c);
+		for (int i = 0; i < f->chain->n; i++) v = runStage(&f->chain->stages[i], &f->state[c][i], v);
+		setValue(out, c, v);
+	}
+}
@@ -0,0 +1,63 @@
+//Host-side filters applied to compensated samples between the sensor and the outputs ("bme280 --filter")
+//A chain of stages runs on every channel of a device separately, each stage feeding the next:
+//ema:<alpha>    exponential moving average y += alpha * (x - y), alpha in (0, 1], smaller is smoother
+//median:<n>     median of the last n samples, n odd from 3 to FILTER_MAX_MEDIAN, rejects n/2 consecutive outliers
+//kalman:<ratio> one-dimensional Kalman filter of a random walk, ratio is process over measurement noise variance,
+//               it averages the first samples evenly and settles to the gain of an EMA, 0.01 to about ema:0.1
+//All stages are linear in scale or order preserving, so they work on fixed-point struct Data as is, i.e. "median:5,ema:0.2".
+//Unlike the on-chip IIR filter, the raw samples remain available and outputs choose which stream they get.
+
+#ifndef BME280_FILTER_H
+#define BME280_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+
+#define FILTER_CHANNELS 3 //t, p, h
+#define FILTER_MAX_STAGES 4
+#define FILTER_MAX_MEDIAN 15
+
+#define FILTER_EMA 0
+#define FILTER_MEDIAN 1
+#define FILTER_KALMAN 2
+
+struct FilterStage
+{
+	uint8_t type; //FILTER_*
+	uint8_t n; //median length
+	double k; //ema alpha or kalman ratio
+};
+
+struct FilterChain
+{
+	struct FilterStage stages[FILTER_MAX_STAGES];
+	int n;
+};
+
+//state of one stage on one channel
+struct FilterState
+{
+	bool init; //a sample has been seen since the last reset
+	double y; //ema and kalman estimate
+	double p; //kalman error variance relative to the measurement noise
+	double buf[FILTER_MAX_MEDIAN]; //median ring
+	uint8_t len, pos;
+};
+
+struct Filter
+{
+	const struct FilterChain * chain;
+	struct FilterState state[FILTER_CHANNELS][FILTER_MAX_STAGES];
+};
+
+//prints what is wrong with spec and returns false if it is invalid
+bool parseFilterChain(const char * spec, struct FilterChain * chain);
+
+void initFilter(struct Filter * f, const struct FilterChain * chain);
+
+//filters the channels in dataType (BME280_TEMP, BME280_PRESS, BME280_HUM) of in to out, the others are copied
+//and their state is reset, so a channel that is enabled again starts from its first sample
+void applyFilter(struct Filter * f, uint8_t dataType, const struct Data * in, struct Data * out);
+
+#endif
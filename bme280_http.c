@@ -0,0 +1,284 @@
+//HTTP server for /metrics, see bme280_http.h
+
+#define _GNU_SOURCE //accept4()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "bme280_http.h"
+
+#define HTTP_MAX_BODY 65536
+
+struct Conn
+{
+	int fd;
+	char in[HTTP_MAX_REQUEST];
+	size_t inLen;
+	char * out; //response, NULL while the request is read
+	size_t outLen;
+	size_t outPos;
+	int slot; //in conns
+	uint64_t deadline_ms; //CLOCK_MONOTONIC time the connection is closed at if it is still open
+};
+
+static int listenFd = -1, stopFd = -1, epollFd = -1;
+static HttpHandler httpHandler;
+static void * httpCtx;
+static pthread_t httpThread;
+static struct Conn * conns[HTTP_MAX_CONNS];
+static int connCount;
+//while the listen socket is out of the epoll set, until resumeAt_ms or a connection closes
+static bool accepting = true;
+static uint64_t resumeAt_ms;
+
+static uint64_t nowMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//the listen socket is level-triggered, a connection it cannot accept would wake epoll_wait() over and over
+static void pauseAccept(uint64_t until_ms) {
+	if (accepting) epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, NULL);
+	accepting = false;
+	resumeAt_ms = until_ms;
+}
+
+static void resumeAccept() {
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listenFd };
+	if (!accepting) epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	accepting = true;
+}
+
+static void closeConn(struct Conn * c) {
+	close(c->fd); //also removes it from the epoll set
+	conns[c->slot] = NULL;
+	connCount--;
+	free(c->out);
+	free(c);
+	resumeAccept();
+}
+
+static void respond(struct Conn * c, int status, const char * reason, const char * type, const char * body, size_t len) {
+	char head[256];
+	int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, reason, type, len);
+	c->out = malloc(n + len);
+	if (!c->out) {
+		c->outLen = c->outPos = 0;
+		return;
+	}
+	memcpy(c->out, head, n);
+	memcpy(c->out + n, body, len);
+	c->outLen = n + len;
+	c->outPos = 0;
+}
+
+//parses the request line once the headers are complete, returns false if more input is needed
+static bool handleRequest(struct Conn * c) {
+	static char body[HTTP_MAX_BODY];
+	char method[8], path[256];
+	c->in[c->inLen] = 0;
+	if (!strstr(c->in, "\r\n\r\n") && !strstr(c->in, "\n\n")) {
+		if (c->inLen < sizeof(c->in) - 1) return false;
+		respond(c, 431, "Request Header Fields Too Large", "text/plain", "", 0);
+		return true;
+	}
+	if (sscanf(c->in, "%7s %255s", method, path) != 2) {
+		respond(c, 400, "Bad Request", "text/plain", "", 0);
+		return true;
+	}
+	if (strcmp(method, "GET") != 0) {
+		respond(c, 405, "Method Not Allowed", "text/plain", "", 0);
+		return true;
+	}
+	char * query = strchr(path, '?');
+	if (query) *query = 0;
+	const char * type = "text/plain";
+	int len = httpHandler(path, body, sizeof(body), &type, httpCtx);
+	if (len < 0) respond(c, 404, "Not Found", "text/plain", "not found\n", 10);
+	else respond(c, 200, "OK", type, body, (size_t)len < sizeof(body) ? (size_t)len : sizeof(body) - 1);
+	return true;
+}
+
+static void onConn(struct Conn * c, uint32_t events) {
+	if (events & (EPOLLERR | EPOLLHUP) && !(events & EPOLLIN)) {
+		closeConn(c);
+		return;
+	}
+	if (!c->out) {
+		ssize_t n;
+		while ((n = read(c->fd, c->in + c->inLen, sizeof(c->in) - 1 - c->inLen)) > 0) {
+			c->inLen += n;
+			if (c->inLen == sizeof(c->in) - 1) break;
+		}
+		//a client may shut down its side right after the request
+		bool eof = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+		if (!handleRequest(c)) {
+			if (eof) closeConn(c);
+			return;
+		}
+		struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
+	//MSG_NOSIGNAL: a client that has gone (EPIPE, ECONNRESET) only closes its connection instead of raising SIGPIPE
+	while (c->outPos < c->outLen) {
+		ssize_t n = send(c->fd, c->out + c->outPos, c->outLen - c->outPos, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return; //wait for EPOLLOUT
+			break;
+		}
+		c->outPos += n;
+	}
+	closeConn(c);
+}
+
+static void closeOldest() {
+	struct Conn * oldest = NULL;
+	for (int i = 0; i < HTTP_MAX_CONNS; i++)
+		if (conns[i] && (!oldest || conns[i]->deadline_ms < oldest->deadline_ms)) oldest = conns[i];
+	closeConn(oldest);
+}
+
+//when all slots or file descriptors are taken the oldest connection makes room, so idle clients cannot lock out
+//a scraper, which is served as soon as it is accepted if its request has arrived already
+static void acceptConns() {
+	while (true) {
+		int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EMFILE && errno != ENFILE && errno != ENOBUFS && errno != ENOMEM) return;
+			if (connCount > 0) {
+				closeOldest();
+				continue;
+			}
+			pauseAccept(nowMs() + HTTP_RETRY_MS);
+			return;
+		}
+		struct Conn * c = calloc(1, sizeof(struct Conn));
+		if (!c) {
+			close(fd);
+			pauseAccept(nowMs() + HTTP_RETRY_MS);
+			return;
+		}
+		if (connCount == HTTP_MAX_CONNS) closeOldest();
+		c->fd = fd;
+		c->deadline_ms = nowMs() + HTTP_TIMEOUT_MS;
+		for (c->slot = 0; conns[c->slot]; c->slot++);
+		conns[c->slot] = c;
+		connCount++;
+		struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = c };
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+		onConn(c, EPOLLIN);
+	}
+}
+
+//epoll_wait() timeout until the next connection deadline or retry of accepting, -1 if there is none
+static int getTimeout(uint64_t now) {
+	uint64_t next = accepting ? UINT64_MAX : resumeAt_ms;
+	for (int i = 0; i < HTTP_MAX_CONNS; i++)
+		if (conns[i] && conns[i]->deadline_ms < next) next = conns[i]->deadline_ms;
+	if (next == UINT64_MAX) return -1;
+	return next > now ? next - now : 0;
+}
+
+static void * httpWorker(void * arg) {
+	struct epoll_event events[HTTP_MAX_EVENTS];
+	while (true) {
+		int n = epoll_wait(epollFd, events, HTTP_MAX_EVENTS, getTimeout(nowMs()));
+		if (n < 0 && errno != EINTR) break;
+		//accepting may close connections, so it comes after the events of this batch that point at them
+		bool pending = false;
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == &stopFd) return NULL;
+			if (events[i].data.ptr == &listenFd) pending = true;
+			else onConn(events[i].data.ptr, events[i].events);
+		}
+		if (pending) acceptConns();
+		//idle or slow clients would hold their slots and file descriptors for good
+		uint64_t now = nowMs();
+		for (int i = 0; i < HTTP_MAX_CONNS; i++)
+			if (conns[i] && conns[i]->deadline_ms <= now) closeConn(conns[i]);
+		if (!accepting && now >= resumeAt_ms) resumeAccept();
+	}
+	return NULL;
+}
+
+bool startHttp(const char * address, HttpHandler handler, void * ctx) {
+	char host[256] = "";
+	const char * port = strrchr(address, ':');
+	if (port) {
+		size_t len = port - address;
+		if (len >= sizeof(host)) return false;
+		memcpy(host, address, len);
+		host[len] = 0;
+		port++;
+	} else
+		port = address;
+	//[::1]:9100
+	char * h = host;
+	if (h[0] == '[' && h[strlen(h) - 1] == ']') {
+		h[strlen(h) - 1] = 0;
+		h++;
+	}
+
+	struct addrinfo hints, * res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	int err = getaddrinfo(*h ? h : NULL, port, &hints, &res);
+	if (err != 0) {
+		printf("startHttp() getaddrinfo error %s\n", gai_strerror(err));
+		return false;
+	}
+	listenFd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+	int one = 1;
+	if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 || bind(listenFd, res->ai_addr, res->ai_addrlen) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+		perror("Unable to listen for metrics");
+		if (listenFd >= 0) close(listenFd);
+		freeaddrinfo(res);
+		return false;
+	}
+	freeaddrinfo(res);
+
+	httpHandler = handler;
+	httpCtx = ctx;
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	stopFd = eventfd(0, EFD_CLOEXEC);
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listenFd };
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	ev.data.ptr = &stopFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &ev);
+	//signals are left to the sampling loop
+	sigset_t block, old;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+	bool ok = pthread_create(&httpThread, NULL, httpWorker, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return ok;
+}
+
+//connections still open are dropped
+void stopHttp() {
+	uint64_t one = 1;
+	if (write(stopFd, &one, sizeof(one)) == sizeof(one)) pthread_join(httpThread, NULL);
+	for (int i = 0; i < HTTP_MAX_CONNS; i++)
+		if (conns[i]) closeConn(conns[i]);
+	close(listenFd);
+	close(stopFd);
+	close(epollFd);
+}
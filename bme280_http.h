@@ -0,0 +1,26 @@
+//Minimal HTTP/1.1 server for "bme280 --metrics", one thread running an epoll loop over non-blocking sockets
+//Only GET is supported and every response closes the connection. Responses are rendered by a handler from memory,
+//so serving never blocks sampling and never touches the sensor.
+//Connections are limited in number and time, the oldest is closed to make room, so idle clients cannot starve it.
+
+#ifndef BME280_HTTP_H
+#define BME280_HTTP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTP_MAX_REQUEST 4096 //larger request headers are rejected
+#define HTTP_MAX_EVENTS 64
+#define HTTP_MAX_CONNS 64 //connections open at once, accepting one more closes the oldest
+#define HTTP_TIMEOUT_MS 5000 //a connection that has not been served by then is closed
+#define HTTP_RETRY_MS 1000 //accepting pauses this long when file descriptors or memory run out
+
+//writes the response body for path into buf of len bytes, returns its length or -1 if path is not found
+//content_type is set to the body's media type
+typedef int (*HttpHandler)(const char * path, char * buf, size_t len, const char ** content_type, void * ctx);
+
+//listens on [host:]port, host defaults to all interfaces, and starts the server thread
+bool startHttp(const char * address, HttpHandler handler, void * ctx);
+void stopHttp();
+
+#endif
@@ -0,0 +1,66 @@
+//Bus transaction accounting, see bme280_instr.h
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bme280.h"
+#include "bme280_instr.h"
+
+static const char * opNames[INSTR_OPS] = { "calib read", "data read", "ctrl read", "ctrl write", "reset" };
+
+int getInstrOp(uint16_t addr, bool write) {
+	if (write) return addr == BME280_RESET_ADDR ? INSTR_RESET : INSTR_CTRL_WRITE;
+	if (addr >= BME280_DATA_ADDR) return INSTR_DATA_READ;
+	if ((addr >= BME280_TEMP_PRESS_CALIB_DATA_ADDR && addr < BME280_TEMP_PRESS_CALIB_DATA_ADDR + BME280_TEMP_PRESS_CALIB_DATA_LEN) ||
+		(addr >= BME280_HUMIDITY_CALIB_DATA_ADDR && addr < BME280_HUMIDITY_CALIB_DATA_ADDR + BME280_HUMIDITY_CALIB_DATA_LEN)) return INSTR_CALIB_READ;
+	return INSTR_CTRL_READ;
+}
+
+void recordInstr(struct Instr * instr, int op, uint64_t ns, uint32_t retries, bool ok) {
+	struct InstrOp * o = &instr->ops[op];
+	uint64_t us = ns / 1000;
+	int i = 0;
+	while (i < INSTR_BUCKETS - 1 && (us >> i) != 0) i++;
+	atomic_fetch_add_explicit(&o->calls, 1, memory_order_relaxed);
+	if (!ok) atomic_fetch_add_explicit(&o->errors, 1, memory_order_relaxed);
+	if (retries) atomic_fetch_add_explicit(&o->retries, retries, memory_order_relaxed);
+	atomic_fetch_add_explicit(&o->total_ns, ns, memory_order_relaxed);
+	atomic_fetch_add_explicit(&o->latency[i], 1, memory_order_relaxed);
+	//one writer per device, a plain compare is enough
+	if (ns > atomic_load_explicit(&o->max_ns, memory_order_relaxed)) atomic_store_explicit(&o->max_ns, ns, memory_order_relaxed);
+}
+
+//upper bound in us of the bucket holding the q-quantile
+static uint32_t getQuantileUs(const uint64_t * latency, uint64_t n, double q) {
+	uint64_t rank = q * n, seen = 0;
+	for (int i = 0; i < INSTR_BUCKETS; i++) {
+		seen += latency[i];
+		if (seen > rank) return 1u << i;
+	}
+	return 1u << (INSTR_BUCKETS - 1);
+}
+
+void printInstr(FILE * f, const char * name, struct Instr * instr) {
+	uint64_t latency[INSTR_BUCKETS];
+	for (int op = 0; op < INSTR_OPS; op++) {
+		struct InstrOp * o = &instr->ops[op];
+		uint64_t calls = atomic_load_explicit(&o->calls, memory_order_relaxed), n = 0;
+		if (calls == 0) continue;
+		for (int i = 0; i < INSTR_BUCKETS; i++) n += latency[i] = atomic_load_explicit(&o->latency[i], memory_order_relaxed);
+		fprintf(f, "%s %s: calls %llu, errors %llu, retries %llu, mean %.1f us, p50 < %u us, p99 < %u us, max %.1f us, histogram",
+			name, opNames[op], (unsigned long long)calls, (unsigned long long)atomic_load_explicit(&o->errors, memory_order_relaxed),
+			(unsigned long long)atomic_load_explicit(&o->retries, memory_order_relaxed),
+			atomic_load_explicit(&o->total_ns, memory_order_relaxed) / 1e3 / calls, getQuantileUs(latency, n, 0.5), getQuantileUs(latency, n, 0.99),
+			atomic_load_explicit(&o->max_ns, memory_order_relaxed) / 1e3);
+		for (int i = 0; i < INSTR_BUCKETS; i++) {
+			if (latency[i] == 0) continue;
+			if (i == 0) fprintf(f, " <1:%llu", (unsigned long long)latency[i]);
+			else if (i == INSTR_BUCKETS - 1) fprintf(f, " >=%u:%llu", 1u << (i - 1), (unsigned long long)latency[i]);
+			else fprintf(f, " %u-%u:%llu", 1u << (i - 1), (1u << i) - 1, (unsigned long long)latency[i]);
+		}
+		fputc('\n', f);
+	}
+	uint64_t corrupt = atomic_load_explicit(&instr->corrupt, memory_order_relaxed);
+	if (corrupt) fprintf(f, "%s corrupt samples %llu\n", name, (unsigned long long)corrupt);
+}
@@ -0,0 +1,49 @@
+//Bus transaction accounting per device and operation: calls, errors, retries and a latency histogram
+//Counters are relaxed atomics updated by the bus worker thread owning the device, so recording takes no lock
+//and they can be dumped from another thread at any time (SIGUSR1, --stats at exit). A dump is not a consistent
+//snapshot across counters, a transaction may be counted in calls but not yet in the histogram.
+
+#ifndef BME280_INSTR_H
+#define BME280_INSTR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//operations, classified by register address, see getInstrOp()
+#define INSTR_CALIB_READ 0 //calibration registers
+#define INSTR_DATA_READ 1 //0xF7-0xFE burst
+#define INSTR_CTRL_READ 2 //chip id, status, ctrl_hum, ctrl_meas and config
+#define INSTR_CTRL_WRITE 3
+#define INSTR_RESET 4 //soft reset write
+#define INSTR_OPS 5
+
+#define INSTR_BUCKETS 24 //bucket i counts latencies in [2^(i-1), 2^i) us, the last one all longer ones
+
+struct InstrOp
+{
+	atomic_ullong calls;
+	atomic_ullong errors; //calls that failed after all retries
+	atomic_ullong retries; //repeated transactions and fallbacks to a slower read method
+	atomic_ullong total_ns;
+	atomic_ullong max_ns;
+	atomic_ullong latency[INSTR_BUCKETS];
+};
+
+struct Instr
+{
+	struct InstrOp ops[INSTR_OPS];
+	atomic_ullong corrupt; //data reads that succeeded but held no valid measurement, see isCorrupt()
+};
+
+//register access to operation
+int getInstrOp(uint16_t addr, bool write);
+
+//one call including its retries, ns is the time of all of them
+void recordInstr(struct Instr * instr, int op, uint64_t ns, uint32_t retries, bool ok);
+
+//one line per operation that was called, with latency percentiles and non-empty histogram buckets, prefixed with name
+void printInstr(FILE * f, const char * name, struct Instr * instr);
+
+#endif
@@ -0,0 +1,68 @@
+//Binary time-series log written by "bme280 --log <file>" and read by bme280log
+//The file is preallocated and memory mapped: a header page, a sparse time index and a ring of fixed size records.
+//Record n (counting from the first one ever written) is stored in slot n % capacity, so the newest capacity records are kept.
+//Every BME280_LOG_INDEX_STRIDE-th record has its timestamp in the index, so a time range is found by binary search over
+//the index followed by a scan of at most BME280_LOG_INDEX_STRIDE records.
+
+#ifndef BME280_LOG_H
+#define BME280_LOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define BME280_LOG_MAGIC 0x474C4542 //"BELG"
+#define BME280_LOG_VERSION 1
+#define BME280_LOG_INDEX_STRIDE 64
+#define BME280_LOG_HEADER_SIZE 4096
+#define BME280_LOG_DEFAULT_RECORDS (1 << 20) //40 MiB, 12 days at 1 Hz
+
+//LogRecord.transport, a sensor is told apart by transport, bus and addr
+//0 was the reserved byte of the first logs, which only came from i2c-dev
+#define BME280_LOG_I2C 0 //bus is N of /dev/i2c-N, addr the I2C address
+#define BME280_LOG_SPI 1 //bus and addr are B and C of /dev/spidevB.C
+#define BME280_LOG_EMU 2 //software sensor "emu", addr the I2C address
+#define BME280_LOG_EMU_SPI 3 //software sensor "emu-spi", bus and addr are 0
+
+struct LogRecord
+{
+	int64_t time_ns; //CLOCK_REALTIME of the sample
+	uint32_t raw_p; //struct UncompData
+	uint32_t raw_t;
+	uint32_t raw_h;
+	uint32_t p; //struct Data
+	int32_t t;
+	uint32_t h;
+	uint8_t bus;
+	uint8_t addr; //I2C address or SPI chip select
+	uint8_t transport; //BME280_LOG_*
+	uint8_t reserved;
+};
+
+struct LogHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t index_stride;
+	uint64_t capacity; //records, a multiple of index_stride
+	atomic_ullong count; //records written so far
+};
+
+static inline uint64_t getLogIndexLen(uint64_t capacity) {
+	return capacity / BME280_LOG_INDEX_STRIDE;
+}
+
+static inline uint64_t getLogFileSize(uint64_t capacity) {
+	return BME280_LOG_HEADER_SIZE + getLogIndexLen(capacity) * sizeof(int64_t) + capacity * sizeof(struct LogRecord);
+}
+
+static inline int64_t * getLogIndex(void * map) {
+	return (int64_t *)((uint8_t *)map + BME280_LOG_HEADER_SIZE);
+}
+
+static inline struct LogRecord * getLogRecords(void * map) {
+	struct LogHeader * hdr = (struct LogHeader *)map;
+	return (struct LogRecord *)(getLogIndex(map) + getLogIndexLen(hdr->capacity));
+}
+
+#endif
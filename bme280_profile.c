@@ -0,0 +1,148 @@
+//Measurement profiles, see bme280_profile.h
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "bme280.h"
+#include "bme280_profile.h"
+
+//oversampling reduces noise and increases the resolution if filter is off.
+//Mostly the pressure is affected by enviromnental fluctuation and hence requires oversampling the most. Humidity is affected the least.
+//if both oversampling and filter are off, the resolution is 16 bit.
+//if filter is on, the temperature and pressure resolution are 20 bits and humidity is 16 bit.
+//if filter is off, the resolution increases by 1 bit for each oversampling step (1, 2, 4, 8, 16) minus 1:
+//for example, with 1X oversampling, it is still 16 bits, with 2X - it is 17 bits and with 16X - it is 20.
+//IIR low pass filter effectively reduces the bandwidth of temperature and pressure output signals and increases the resolution of those signals to 20 bits
+//IIR formula: data = (old_data * (filter_coeff - 1) + new_data) / filter_coeff
+//the higher the coefficient, the slower the sensor response as it takes more samples
+//with coeff = 2, it takes 8 samples to fully measure the environmental change; with coeff = 4 - 18 , with coeff = 8, more than 32, a and with coeff = 16, even much more samples
+const struct Profile presets[] = {
+	//settings field order is osr_p, osr_t, osr_h, filter, standby_time
+	{ PROFILE_DEFAULT, { BME280_OVERSAMPLING_16X, BME280_OVERSAMPLING_16X, BME280_OVERSAMPLING_16X, BME280_FILTER_COEFF_16, BME280_STANDBY_TIME_10_MS }, BME280_NORMAL_MODE },
+	//one measurement per minute needs neither oversampling nor IIR filter,
+	//a 1x measurement of all three channels takes less than 10ms, so the sensor is asleep nearly all the time
+	{ "weather", { BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_FILTER_COEFF_OFF, BME280_STANDBY_TIME_1000_MS }, BME280_FORCED_MODE },
+	//one measurement per second, pressure is not measured
+	{ "humidity", { BME280_NO_OVERSAMPLING, BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_FILTER_COEFF_OFF, BME280_STANDBY_TIME_1000_MS }, BME280_FORCED_MODE },
+	//low noise pressure for altitude changes of a floor, about 25 Hz
+	{ "indoor", { BME280_OVERSAMPLING_16X, BME280_OVERSAMPLING_2X, BME280_OVERSAMPLING_1X, BME280_FILTER_COEFF_16, BME280_STANDBY_TIME_0_5_MS }, BME280_NORMAL_MODE },
+	//fast pressure response, about 83 Hz, humidity is not measured
+	{ "gaming", { BME280_OVERSAMPLING_4X, BME280_OVERSAMPLING_1X, BME280_NO_OVERSAMPLING, BME280_FILTER_COEFF_16, BME280_STANDBY_TIME_0_5_MS }, BME280_NORMAL_MODE },
+};
+const int presetsCount = sizeof(presets) / sizeof(presets[0]);
+
+static bool parseOversampling(const char * val, uint8_t * osr) {
+	static const char * values[] = { "0", "1", "2", "4", "8", "16" };
+	for (uint8_t i = 0; i < 6; i++)
+		if (strcmp(val, values[i]) == 0) {
+			*osr = i;
+			return true;
+		}
+	return false;
+}
+
+static bool parseFilter(const char * val, uint8_t * filter) {
+	static const char * values[] = { "0", "2", "4", "8", "16" };
+	for (uint8_t i = 0; i < 5; i++)
+		if (strcmp(val, values[i]) == 0 || (i == 0 && strcasecmp(val, "off") == 0)) {
+			*filter = i;
+			return true;
+		}
+	return false;
+}
+
+//register values in the order of BME280_STANDBY_TIME_*
+static bool parseStandby(const char * val, uint8_t * standby_time) {
+	static const char * values[] = { "0.5", "62.5", "125", "250", "500", "1000", "10", "20" };
+	for (uint8_t i = 0; i < 8; i++)
+		if (strcmp(val, values[i]) == 0) {
+			*standby_time = i;
+			return true;
+		}
+	return false;
+}
+
+bool parseProfile(const char * spec, struct Profile * profile) {
+	char buf[PROFILE_MAX_LINE], * opt, * saveptr;
+	bool first = true;
+	if (strlen(spec) >= sizeof(buf)) {
+		printf("error: profile %s is too long\n", spec);
+		return false;
+	}
+	strcpy(buf, spec);
+	*profile = presets[0];
+	for (opt = strtok_r(buf, ",", &saveptr); opt; opt = strtok_r(NULL, ",", &saveptr), first = false) {
+		char * val = strchr(opt, '=');
+		if (!val) {
+			int i;
+			for (i = 0; i < presetsCount && strcasecmp(opt, presets[i].name) != 0; i++);
+			if (!first || i == presetsCount) {
+				printf("error: %s is not a preset, it must come first and be one of", opt);
+				for (i = 0; i < presetsCount; i++) printf(" %s", presets[i].name);
+				printf("\n");
+				return false;
+			}
+			*profile = presets[i];
+			continue;
+		}
+		*val++ = 0;
+		bool ok;
+		if (strcmp(opt, "osr_t") == 0) ok = parseOversampling(val, &profile->settings.osr_t) && profile->settings.osr_t != BME280_NO_OVERSAMPLING;
+		else if (strcmp(opt, "osr_p") == 0) ok = parseOversampling(val, &profile->settings.osr_p);
+		else if (strcmp(opt, "osr_h") == 0) ok = parseOversampling(val, &profile->settings.osr_h);
+		else if (strcmp(opt, "filter") == 0) ok = parseFilter(val, &profile->settings.filter);
+		else if (strcmp(opt, "standby") == 0) ok = parseStandby(val, &profile->settings.standby_time);
+		else if (strcmp(opt, "mode") == 0) {
+			ok = strcasecmp(val, "normal") == 0 || strcasecmp(val, "forced") == 0;
+			profile->mode = tolower(val[0]) == 'f' ? BME280_FORCED_MODE : BME280_NORMAL_MODE;
+		} else {
+			printf("error: unknown profile setting %s\n", opt);
+			return false;
+		}
+		//pressure and humidity are compensated with the temperature, so it cannot be skipped
+		if (!ok) {
+			printf("error: invalid %s=%s%s\n", opt, val, strcmp(opt, "osr_t") == 0 ? ", temperature oversampling cannot be 0" : "");
+			return false;
+		}
+	}
+	return true;
+}
+
+//i2c-1:77 matches /dev/i2c-1 and address 77
+static bool matchDevice(const char * device, const char * bus, uint16_t addr) {
+	const char * colon = strchr(device, ':');
+	size_t len = colon ? (size_t)(colon - device) : strlen(device);
+	uint16_t a = colon ? strtoul(colon + 1, NULL, 16) : BME280_I2C_ADDR_PRIM;
+	const char * b = strrchr(bus, '/');
+	if (a != addr) return false;
+	if (strlen(bus) == len && strncmp(device, bus, len) == 0) return true;
+	return b && strlen(b + 1) == len && strncmp(device, b + 1, len) == 0;
+}
+
+int loadProfile(const char * path, const char * bus, uint16_t addr, struct Profile * profile) {
+	char line[PROFILE_MAX_LINE], device[64], spec[PROFILE_MAX_LINE];
+	int n = 0, found = 0;
+	FILE * f = fopen(path, "r");
+	if (!f) {
+		perror("Unable to open profile file");
+		return -1;
+	}
+	while (found == 0 && fgets(line, sizeof(line), f)) {
+		n++;
+		char * hash = strchr(line, '#');
+		if (hash) *hash = 0;
+		int fields = sscanf(line, "%63s %255s", device, spec);
+		if (fields <= 0) continue;
+		if (fields != 2) {
+			printf("error: %s line %d is not <i2c-dev>[:addr] <profile>\n", path, n);
+			found = -1;
+		} else if (matchDevice(device, bus, addr))
+			found = parseProfile(spec, profile) ? 1 : -1;
+	}
+	fclose(f);
+	return found;
+}
@@ -0,0 +1,36 @@
+//Measurement profiles: oversampling, IIR filter, standby time and mode of a sensor, selected with --profile and --config
+//A profile is a preset, optionally followed by settings overriding it, or settings alone, which override "default":
+//"indoor", "gaming,standby=62.5", "osr_p=8,osr_t=1,osr_h=0,filter=4" or "weather,mode=normal,standby=1000"
+//oversampling osr_t, osr_p, osr_h: 0 (skipped), 1, 2, 4, 8 or 16; filter: 0 (off), 2, 4, 8 or 16;
+//standby in ms: 0.5, 10, 20, 62.5, 125, 250, 500 or 1000; mode: normal or forced
+//A profile file assigns profiles to devices, one "<i2c-dev>[:addr] <profile>" per line, # starts a comment,
+//i.e. "i2c-1:77 indoor". i2c-dev may be given with or without /dev/.
+
+#ifndef BME280_PROFILE_H
+#define BME280_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+
+#define PROFILE_DEFAULT "default"
+#define PROFILE_MAX_LINE 256
+
+struct Profile
+{
+	char name[16]; //preset the profile is based on
+	struct Settings settings;
+	uint8_t mode; //BME280_NORMAL_MODE or BME280_FORCED_MODE
+};
+
+//presets from the datasheet, section 3.5, and the default, which favors resolution over response time
+extern const struct Profile presets[];
+extern const int presetsCount;
+
+//prints what is wrong with spec and returns false if it is invalid
+bool parseProfile(const char * spec, struct Profile * profile);
+
+//profile of bus and addr in the profile file at path, returns 1 if found, 0 if the device is not listed and -1 on error
+int loadProfile(const char * path, const char * bus, uint16_t addr, struct Profile * profile);
+
+#endif
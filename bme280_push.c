@@ -0,0 +1,344 @@
+//Batched push exporter, see bme280_push.h
+
+#define _GNU_SOURCE //strcasestr()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "bme280_push.h"
+
+#define PUSH_MAX_RESPONSE 4096 //response headers kept, the body is read and dropped
+
+static char host[256], port[8] = "80", path[512];
+static uint32_t batchMax, ageMs;
+static int sock = -1, spoolFd = -1;
+static off_t spoolOffset; //replayed so far, the spool is truncated once all of it is
+static int64_t retryAt; //next replay attempt while the endpoint is down
+static uint32_t backoffMs = PUSH_RETRY_MIN_MS;
+
+//samples queued by pushSample() and pushAggregate() for the sender thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static char * queue;
+static size_t queueLen, queueCap;
+static uint32_t queueCount;
+static uint64_t queueLost; //samples not queued for lack of memory
+static int64_t queueStart; //when the oldest queued sample was queued
+static bool stopping;
+static pthread_t pushThread;
+
+static int64_t nowMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool parseUrl(const char * url) {
+	if (strncasecmp(url, "http://", 7) != 0) return false;
+	const char * h = url + 7, * slash = strchr(h, '/'), * end = slash ? slash : h + strlen(h);
+	const char * colon = h[0] == '[' ? strstr(h, "]:") : strchr(h, ':');
+	if (colon && colon > end) colon = NULL;
+	if (colon && h[0] == '[') colon++;
+	const char * hostEnd = colon ? colon : end;
+	if (h[0] == '[') {
+		h++;
+		if (hostEnd[-1] == ']') hostEnd--;
+	}
+	if (hostEnd <= h || (size_t)(hostEnd - h) >= sizeof(host)) return false;
+	memcpy(host, h, hostEnd - h);
+	host[hostEnd - h] = 0;
+	if (colon) {
+		if (end - colon - 1 <= 0 || (size_t)(end - colon - 1) >= sizeof(port)) return false;
+		memcpy(port, colon + 1, end - colon - 1);
+		port[end - colon - 1] = 0;
+	}
+	snprintf(path, sizeof(path), "%s", slash ? slash : "/");
+	return true;
+}
+
+static void disconnect() {
+	if (sock >= 0) close(sock);
+	sock = -1;
+}
+
+static bool connectPush() {
+	struct addrinfo hints, * res, * ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0) return false;
+	struct timeval tv = { PUSH_TIMEOUT_MS / 1000, (PUSH_TIMEOUT_MS % 1000) * 1000 };
+	for (ai = res; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (sock < 0) continue;
+		//on Linux the send timeout also bounds connect()
+		setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) break;
+		disconnect();
+	}
+	freeaddrinfo(res);
+	return sock >= 0;
+}
+
+static bool sendAll(const char * buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+//reads the response to one request, returns the status code or -1 if the connection failed
+//keep is cleared if the server closes the connection or its framing is not understood
+static int readResponse(bool * keep) {
+	char buf[PUSH_MAX_RESPONSE + 1], * body;
+	size_t len = 0;
+	ssize_t n;
+	while (true) {
+		n = recv(sock, buf + len, PUSH_MAX_RESPONSE - len, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return -1;
+		len += n;
+		buf[len] = 0;
+		if ((body = strstr(buf, "\r\n\r\n"))) break;
+		if (len == PUSH_MAX_RESPONSE) return -1;
+	}
+	body += 4;
+	int status;
+	if (sscanf(buf, "HTTP/1.%*d %d", &status) != 1) return -1;
+	*keep = strncmp(buf, "HTTP/1.1", 8) == 0 && !strcasestr(buf, "\r\nConnection: close");
+	char * cl = strcasestr(buf, "\r\nContent-Length:");
+	if (!cl) {
+		//no body if 204 or 304, otherwise it ends with the connection (or is chunked, not supported)
+		if (status != 204 && status != 304) *keep = false;
+		return status;
+	}
+	size_t rest = strtoul(cl + 17, NULL, 10), got = len - (body - buf);
+	while (got < rest) {
+		n = recv(sock, buf, rest - got < PUSH_MAX_RESPONSE ? rest - got : PUSH_MAX_RESPONSE, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) {
+			*keep = false;
+			break;
+		}
+		got += n;
+	}
+	return status;
+}
+
+//returns true if the endpoint accepted the lines or rejected them for good (4xx, they would be rejected again)
+static bool post(const char * body, size_t len) {
+	char head[1024];
+	int n = snprintf(head, sizeof(head), "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: %zu\r\n\r\n", path, host, len);
+	//a kept-alive connection may have been closed by the server meanwhile, so a failure on it is retried on a new one
+	for (int attempt = 0; attempt < 2; attempt++) {
+		bool fresh = sock < 0, keep = false;
+		if (fresh && !connectPush()) return false;
+		int status = -1;
+		if (sendAll(head, n) && sendAll(body, len)) status = readResponse(&keep);
+		if (!keep || status < 0) disconnect();
+		if (status >= 200 && status < 300) return true;
+		if (status >= 400 && status < 500) {
+			fprintf(stderr, "push: endpoint rejected %zu bytes with status %d, dropped\n", len, status);
+			return true;
+		}
+		if (status > 0 || fresh) return false;
+	}
+	return false;
+}
+
+static off_t getSpoolSize() {
+	struct stat st;
+	return fstat(spoolFd, &st) == 0 ? st.st_size : 0;
+}
+
+static void appendSpool(const char * buf, size_t len) {
+	//O_APPEND, so each batch lands whole after the previous one
+	if (write(spoolFd, buf, len) != (ssize_t)len || fdatasync(spoolFd) != 0)
+		perror("push: unable to append to spool, samples lost");
+}
+
+static void scheduleRetry() {
+	retryAt = nowMs() + backoffMs;
+	backoffMs = backoffMs * 2 > PUSH_RETRY_MAX_MS ? PUSH_RETRY_MAX_MS : backoffMs * 2;
+}
+
+//sends the spool from spoolOffset in requests ending on line boundaries, truncates it when all was delivered
+static void replaySpool() {
+	static char buf[PUSH_REPLAY_BYTES];
+	off_t size = getSpoolSize();
+	while (spoolOffset < size) {
+		ssize_t n = pread(spoolFd, buf, sizeof(buf), spoolOffset);
+		if (n <= 0) break;
+		size_t len = n;
+		while (len > 0 && buf[len - 1] != '\n') len--;
+		if (len == 0) len = n; //a line longer than the buffer, should not happen
+		if (!post(buf, len)) {
+			scheduleRetry();
+			return;
+		}
+		spoolOffset += len;
+	}
+	if (ftruncate(spoolFd, 0) != 0) perror("push: unable to truncate spool");
+	spoolOffset = 0;
+	backoffMs = PUSH_RETRY_MIN_MS;
+}
+
+//batches go to the spool while it has anything, so the endpoint always receives samples in order
+static void deliver(const char * buf, size_t len) {
+	if (getSpoolSize() == 0) {
+		if (post(buf, len)) return;
+		scheduleRetry();
+	}
+	appendSpool(buf, len);
+}
+
+static void * pushWorker(void * arg) {
+	char * batch = NULL;
+	size_t batchCap = 0;
+	pthread_mutex_lock(&lock);
+	while (true) {
+		int64_t now = nowMs();
+		bool due = queueCount > 0 && (queueCount >= batchMax || now - queueStart >= ageMs || stopping);
+		bool retry = spoolFd >= 0 && getSpoolSize() > 0 && now >= retryAt;
+		if (!due && !retry) {
+			if (stopping) break;
+			int64_t wake = INT64_MAX;
+			if (queueCount > 0) wake = queueStart + ageMs;
+			if (getSpoolSize() > 0 && retryAt < wake) wake = retryAt;
+			if (wake == INT64_MAX) pthread_cond_wait(&cond, &lock);
+			else {
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				int64_t ms = wake - now;
+				ts.tv_sec += ms / 1000;
+				ts.tv_nsec += (ms % 1000) * 1000000;
+				if (ts.tv_nsec >= 1000000000) {
+					ts.tv_sec++;
+					ts.tv_nsec -= 1000000000;
+				}
+				pthread_cond_timedwait(&cond, &lock, &ts);
+			}
+			continue;
+		}
+		//swap buffers, so samples keep being queued while the batch is sent
+		size_t len = 0;
+		if (due) {
+			char * t = batch;
+			size_t c = batchCap;
+			batch = queue;
+			batchCap = queueCap;
+			len = queueLen;
+			queue = t;
+			queueCap = c;
+			queueLen = 0;
+			queueCount = 0;
+		}
+		pthread_mutex_unlock(&lock);
+		if (due) deliver(batch, len);
+		if (getSpoolSize() > 0 && nowMs() >= retryAt) replaySpool();
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	free(batch);
+	return NULL;
+}
+
+bool startPush(const char * url, const char * spool, uint32_t batch, uint32_t age_ms) {
+	if (!parseUrl(url)) {
+		printf("error: push url %s is not http://host[:port]/path\n", url);
+		return false;
+	}
+	spoolFd = open(spool, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (spoolFd < 0) {
+		perror("Unable to open push spool");
+		return false;
+	}
+	batchMax = batch;
+	ageMs = age_ms;
+	//a spool left by a previous run is replayed right away
+	retryAt = 0;
+	backoffMs = PUSH_RETRY_MIN_MS;
+	spoolOffset = 0;
+	stopping = false;
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond, &attr);
+	//signals are left to the sampling loop
+	sigset_t block, old;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+	bool ok = pthread_create(&pushThread, NULL, pushWorker, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return ok;
+}
+
+static void queueLine(const char * line, int n) {
+	pthread_mutex_lock(&lock);
+	if (queueLen + n > queueCap) {
+		char * q = realloc(queue, (queueLen + n) * 2);
+		if (!q) {
+			queueLost++;
+			pthread_mutex_unlock(&lock);
+			return;
+		}
+		queue = q;
+		queueCap = (queueLen + n) * 2;
+	}
+	memcpy(queue + queueLen, line, n);
+	queueLen += n;
+	if (queueCount++ == 0) queueStart = nowMs();
+	if (queueCount >= batchMax) pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+void pushSample(const char * bus, uint16_t addr, const struct Data * data, int64_t time_ns) {
+	char line[160];
+	const char * b = strrchr(bus, '/');
+	int n = snprintf(line, sizeof(line), "bme280,bus=%s,addr=%02x t=%.2f,h=%.3f,p=%.4f %lld\n",
+		b ? b + 1 : bus, addr, data->t / 100.0, data->h / 1024.0, data->p / 25600.0, (long long)time_ns);
+	queueLine(line, n);
+}
+
+void pushAggregate(const char * bus, uint16_t addr, const struct WindowData * agg) {
+	char line[320];
+	const char * b = strrchr(bus, '/');
+	int n = snprintf(line, sizeof(line),
+		"bme280,bus=%s,addr=%02x t=%.2f,h=%.3f,p=%.4f,t_min=%.2f,t_max=%.2f,h_min=%.3f,h_max=%.3f,p_min=%.4f,p_max=%.4f,n=%ui %lld\n",
+		b ? b + 1 : bus, addr, agg->avg.t / 100.0, agg->avg.h / 1024.0, agg->avg.p / 25600.0, agg->min.t / 100.0, agg->max.t / 100.0,
+		agg->min.h / 1024.0, agg->max.h / 1024.0, agg->min.p / 25600.0, agg->max.p / 25600.0, agg->count, (long long)agg->end_ns);
+	queueLine(line, n);
+}
+
+void stopPush() {
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(pushThread, NULL);
+	disconnect();
+	close(spoolFd);
+	free(queue);
+	if (queueLost) fprintf(stderr, "push: %llu samples lost, out of memory\n", (unsigned long long)queueLost);
+}
@@ -0,0 +1,35 @@
+//Push exporter for "bme280 --push <url>": samples are sent in Influx line protocol, in batches, over one persistent
+//HTTP/1.1 connection, i.e. to InfluxDB's /write?db=env or any endpoint accepting line protocol POSTs.
+//A batch is sent when it has batch samples or its oldest sample is age_ms old. Batches that cannot be delivered are
+//appended to a spool file and replayed in order, before any newer batch, once the endpoint answers again.
+//A replay interrupted by a restart is repeated from the start of the spool, line protocol writes are idempotent.
+
+#ifndef BME280_PUSH_H
+#define BME280_PUSH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+#include "bme280_window.h"
+
+#define PUSH_DEFAULT_BATCH 60
+#define PUSH_DEFAULT_AGE_MS 10000
+#define PUSH_DEFAULT_SPOOL "/var/tmp/bme280-push.spool"
+#define PUSH_TIMEOUT_MS 5000 //connect, send and response timeout
+#define PUSH_RETRY_MIN_MS 1000 //backoff while the endpoint is down
+#define PUSH_RETRY_MAX_MS 60000
+#define PUSH_REPLAY_BYTES 65536 //spool is replayed in requests of at most this size
+
+//url is http://host[:port]/path, starts the sender thread
+bool startPush(const char * url, const char * spool, uint32_t batch, uint32_t age_ms);
+
+//queues one sample, never blocks on the network
+void pushSample(const char * bus, uint16_t addr, const struct Data * data, int64_t time_ns);
+
+//queues the average, extremes and sample count of a window, timestamped with the end of the window
+void pushAggregate(const char * bus, uint16_t addr, const struct WindowData * agg);
+
+//sends or spools what is queued and stops the sender thread
+void stopPush();
+
+#endif
@@ -0,0 +1,105 @@
+//Lock-free SPSC ring, see bme280_ring.h
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bme280_ring.h"
+
+static const char * policyNames[] = { "drop-oldest", "drop-newest", "block" };
+
+bool initRing(struct Ring * r, uint32_t capacity, size_t size, int policy) {
+	memset(r, 0, sizeof(struct Ring));
+	r->cap = 1;
+	while (r->cap < capacity) r->cap <<= 1;
+	r->size = size;
+	r->policy = policy;
+	r->buf = calloc(r->cap, size);
+	if (!r->buf) return false;
+	sem_init(&r->items, 0, 0);
+	sem_init(&r->space, 0, 0);
+	return true;
+}
+
+void freeRing(struct Ring * r) {
+	sem_destroy(&r->items);
+	sem_destroy(&r->space);
+	free(r->buf);
+	r->buf = NULL;
+}
+
+//RING_BLOCK waits through signals that do not stop the producer, such as SIGHUP or SIGUSR1
+bool pushRing(struct Ring * r, const void * elem) {
+	uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (h - t >= r->cap) {
+		switch (r->policy) {
+		case RING_DROP_NEWEST:
+			atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+			return false;
+		case RING_DROP_OLDEST:
+			//fails only if the consumer has just taken the oldest element, which makes room as well
+			if (atomic_compare_exchange_strong(&r->tail, &t, t + 1)) atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+			break;
+		case RING_BLOCK:
+			atomic_fetch_add_explicit(&r->blocked, 1, memory_order_relaxed);
+			while (h - atomic_load_explicit(&r->tail, memory_order_acquire) >= r->cap) {
+				if (atomic_load(&r->closed) || (r->stop && *r->stop)) {
+					atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+					return false;
+				}
+				sem_wait(&r->space);
+			}
+			break;
+		}
+	}
+	memcpy(r->buf + (h & (r->cap - 1)) * r->size, elem, r->size);
+	atomic_store_explicit(&r->head, h + 1, memory_order_release);
+	atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+	uint32_t n = h + 1 - atomic_load_explicit(&r->tail, memory_order_relaxed);
+	if (n > atomic_load_explicit(&r->highWater, memory_order_relaxed)) atomic_store_explicit(&r->highWater, n, memory_order_relaxed);
+	sem_post(&r->items);
+	return true;
+}
+
+bool popRing(struct Ring * r, void * elem) {
+	while (true) {
+		uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+		if (t == atomic_load_explicit(&r->head, memory_order_acquire)) return false;
+		memcpy(elem, r->buf + (t & (r->cap - 1)) * r->size, r->size);
+		//the producer dropped this element and may be overwriting it, the copy is retried with the next one
+		if (atomic_compare_exchange_strong(&r->tail, &t, t + 1)) {
+			if (r->policy == RING_BLOCK) sem_post(&r->space);
+			return true;
+		}
+	}
+}
+
+bool waitRing(struct Ring * r) {
+	while (true) {
+		if (atomic_load_explicit(&r->head, memory_order_acquire) != atomic_load_explicit(&r->tail, memory_order_acquire)) return true;
+		if (atomic_load(&r->closed)) return false;
+		sem_wait(&r->items);
+	}
+}
+
+void closeRing(struct Ring * r) {
+	atomic_store(&r->closed, true);
+	sem_post(&r->items);
+	sem_post(&r->space);
+}
+
+bool parseBackpressure(const char * arg, int * policy) {
+	for (int i = 0; i < 3; i++)
+		if (strcmp(arg, policyNames[i]) == 0) {
+			*policy = i;
+			return true;
+		}
+	return false;
+}
+
+const char * getBackpressureName(int policy) {
+	return policyNames[policy];
+}
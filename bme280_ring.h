@@ -0,0 +1,61 @@
+//Fixed-capacity lock-free single-producer/single-consumer ring of equally sized elements, it carries samples from the
+//sampling loop to the output writer thread, so slow output (a full pipe, a stalled disk) does not delay sensor reads.
+//Head is advanced by the producer only. Tail is advanced by the consumer and, with RING_DROP_OLDEST, by the producer
+//making room, so the consumer copies an element first and claims it with a compare-and-swap of tail, a copy whose slot
+//was overwritten meanwhile is discarded. Waiting (an empty ring, RING_BLOCK on a full one) uses semaphores, which
+//take no syscall unless a thread actually sleeps.
+
+#ifndef BME280_RING_H
+#define BME280_RING_H
+
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//backpressure, what pushRing() does when the ring is full
+#define RING_DROP_OLDEST 0 //overwrite the oldest element
+#define RING_DROP_NEWEST 1 //discard the new element
+#define RING_BLOCK 2 //wait for the consumer
+
+struct Ring
+{
+	uint8_t * buf;
+	size_t size; //of an element
+	uint32_t cap; //power of 2
+	int policy; //RING_*
+	_Alignas(64) atomic_ullong head; //next element written
+	_Alignas(64) atomic_ullong tail; //next element read
+	_Alignas(64) atomic_ullong pushed;
+	atomic_ullong dropped; //elements lost to backpressure
+	atomic_ullong blocked; //pushes that had to wait with RING_BLOCK
+	atomic_uint highWater; //most elements queued at once
+	sem_t items; //posted for every push, the consumer sleeps on it
+	sem_t space; //posted for every pop with RING_BLOCK, the producer sleeps on it
+	atomic_bool closed;
+	volatile sig_atomic_t * stop; //optional flag of the producer, a RING_BLOCK push gives up once a signal handler sets it
+};
+
+//capacity is rounded up to a power of 2
+bool initRing(struct Ring * r, uint32_t capacity, size_t size, int policy);
+void freeRing(struct Ring * r);
+
+//copies elem in, returns false if it was dropped (RING_DROP_NEWEST) or the ring was closed or stop set while waiting (RING_BLOCK)
+bool pushRing(struct Ring * r, const void * elem);
+
+//copies the oldest element to elem, returns false if the ring is empty
+bool popRing(struct Ring * r, void * elem);
+
+//waits until an element may be there or the ring is closed, returns false if it is closed and empty
+bool waitRing(struct Ring * r);
+
+//wakes up both sides for good, the consumer drains what is left
+void closeRing(struct Ring * r);
+
+//parses drop-oldest, drop-newest or block
+bool parseBackpressure(const char * arg, int * policy);
+const char * getBackpressureName(int policy);
+
+#endif
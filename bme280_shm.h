@@ -0,0 +1,66 @@
+//Shared memory segment published by "bme280 --daemon" and read by bme280c
+//The latest sample is guarded by a seqlock: the writer makes seq odd while it updates the sample and even when done,
+//readers copy the sample and retry if seq was odd or changed meanwhile, so reading never blocks the writer and needs no syscalls
+
+#ifndef BME280_SHM_H
+#define BME280_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BME280_SHM_MAGIC 0x42455348 //"BESH"
+#define BME280_SHM_VERSION 1
+#define BME280_SHM_MAX_AGE_INTERVALS 5 //readers treat older samples as stale (daemon is gone or stuck)
+
+struct ShmSample
+{
+	int64_t time_ns; //CLOCK_REALTIME of the sample
+	uint64_t count; //number of samples published so far
+	uint32_t p; //pressure, same units as struct Data
+	int32_t t; //temperature
+	uint32_t h; //humidity
+	uint32_t reserved;
+};
+
+struct Shm
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t pid; //daemon pid
+	uint32_t interval_ms; //daemon sampling interval
+	atomic_uint seq;
+	uint32_t reserved;
+	struct ShmSample sample;
+};
+
+//segment name is keyed by bus and address, i.e. /bme280-i2c-1-76
+static inline void getShmName(const char * device, uint16_t addr, char * name, size_t len) {
+	const char * bus = strrchr(device, '/');
+	bus = bus ? bus + 1 : device;
+	snprintf(name, len, "/bme280-%s-%02x", bus, addr);
+}
+
+static inline void writeShm(struct Shm * shm, const struct ShmSample * sample) {
+	unsigned seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy((void *)&shm->sample, sample, sizeof(struct ShmSample));
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
+//returns false if no sample has been published yet
+static inline bool readShm(const struct Shm * shm, struct ShmSample * sample) {
+	unsigned seq1, seq2;
+	do {
+		seq1 = atomic_load_explicit((atomic_uint *)&shm->seq, memory_order_acquire);
+		memcpy(sample, (const void *)&shm->sample, sizeof(struct ShmSample));
+		atomic_thread_fence(memory_order_acquire);
+		seq2 = atomic_load_explicit((atomic_uint *)&shm->seq, memory_order_relaxed);
+	} while ((seq1 & 1) || seq1 != seq2);
+	return seq1 != 0;
+}
+
+#endif
@@ -0,0 +1,75 @@
+//SPI register access, see bme280_spi.h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "bme280_spi.h"
+
+bool openSpi(struct Spi * spi, const char * path, uint32_t speed_hz, struct Emu * emu) {
+	uint8_t mode = SPI_MODE_0, bits = 8;
+	spi->fd = -1;
+	spi->speed_hz = speed_hz;
+	spi->emu = emu;
+	if (emu) return true;
+	spi->fd = open(path, O_RDWR);
+	if (spi->fd < 0) {
+		perror("Unable to open spi device");
+		return false;
+	}
+	if (ioctl(spi->fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(spi->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+		ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+		perror("setting spi mode, word size or speed failed");
+		closeSpi(spi);
+		return false;
+	}
+	return true;
+}
+
+void closeSpi(struct Spi * spi) {
+	if (spi->fd >= 0) close(spi->fd);
+	spi->fd = -1;
+}
+
+static int transferSpi(struct Spi * spi, const uint8_t * tx, uint8_t * rx, uint16_t len) {
+	if (spi->emu) return transferEmuSpi(spi->emu, tx, rx, len);
+	struct spi_ioc_transfer xfer;
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.tx_buf = (uintptr_t)tx;
+	xfer.rx_buf = (uintptr_t)rx;
+	xfer.len = len;
+	xfer.speed_hz = spi->speed_hz;
+	xfer.bits_per_word = 8;
+	return ioctl(spi->fd, SPI_IOC_MESSAGE(1), &xfer) < 0 ? -1 : len;
+}
+
+int readSpi(struct Spi * spi, uint8_t addr, uint8_t * buf, uint16_t len) {
+	uint8_t tx[SPI_MAX_TRANSFER], rx[SPI_MAX_TRANSFER];
+	if (len >= SPI_MAX_TRANSFER) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(tx, 0, len + 1);
+	tx[0] = addr | 0x80;
+	if (transferSpi(spi, tx, rx, len + 1) < 0) return -1;
+	memcpy(buf, rx + 1, len);
+	return len;
+}
+
+int writeSpi(struct Spi * spi, const uint8_t * regs, uint8_t n) {
+	uint8_t tx[SPI_MAX_TRANSFER], rx[SPI_MAX_TRANSFER];
+	if (n == 0 || 2 * n > SPI_MAX_TRANSFER) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < n; i++) {
+		tx[2 * i] = regs[2 * i] & 0x7F;
+		tx[2 * i + 1] = regs[2 * i + 1];
+	}
+	return transferSpi(spi, tx, rx, 2 * n) < 0 ? -1 : 0;
+}
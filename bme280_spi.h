@@ -0,0 +1,34 @@
+//4-wire SPI access to the BME280 through spidev ("bme280 /dev/spidev0.0"), or to the software sensor ("bme280 emu-spi")
+//Register addresses are sent with bit 7 set to read and cleared to write (datasheet 6.3). A burst read is one full-duplex
+//transfer: the control byte, then one dummy byte per register clocked out while SDO clocks the registers in. Writes are
+//control and data byte pairs, so any number of them goes out in one transfer with CSB held low, in order.
+//Each of them is a single SPI_IOC_MESSAGE ioctl. Mode 0 is used, the sensor supports modes 0 and 3.
+
+#ifndef BME280_SPI_H
+#define BME280_SPI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280_emu.h"
+
+#define SPI_DEFAULT_SPEED_HZ 10000000 //datasheet maximum
+#define SPI_MAX_TRANSFER 64 //bytes of a transfer, the longest read is the 26 calibration registers
+
+struct Spi
+{
+	int fd; //spidev, -1 for the software sensor
+	uint32_t speed_hz;
+	struct Emu * emu; //software sensor the transfers go to instead of spidev, see transferEmuSpi()
+};
+
+//opens spidev at path or, if emu is given, loops the transfers back to it, prints the error and returns false on failure
+bool openSpi(struct Spi * spi, const char * path, uint32_t speed_hz, struct Emu * emu);
+void closeSpi(struct Spi * spi);
+
+//reads len consecutive registers from addr in one transfer, returns len or -1 with errno set
+int readSpi(struct Spi * spi, uint8_t addr, uint8_t * buf, uint16_t len);
+
+//writes n registers given as address and value pairs in one transfer, returns 0 or -1 with errno set
+int writeSpi(struct Spi * spi, const uint8_t * regs, uint8_t n);
+
+#endif
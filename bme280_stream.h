@@ -0,0 +1,134 @@
+//Delta stream written by "bme280 --stream <file>" and read by bme280stream, a compact feed for other processes
+//A 5 byte header ("BE2S", version) is followed by records of LEB128 varints, signed values zigzag encoded:
+//a device record before the first sample of a device: id << 2, name length, name (i.e. i2c-1:76)
+//a sample record: id << 2 | 1 and the us since the previous sample record or, for the first one and after the clock
+//was stepped back, id << 2 | 2 and the us since the epoch, then t, p and h as differences from the previous sample
+//of the device (from 0 for its first), in the units of struct Data.
+//A sample of a slowly changing sensor takes 6 to 9 bytes, a channel not measured is 0 and costs one byte.
+
+#ifndef BME280_STREAM_H
+#define BME280_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BME280_STREAM_VERSION 1
+#define BME280_STREAM_MAX_DEVICES 32 //ids fit the first byte of a record
+#define BME280_STREAM_MAX_RECORD 64 //bytes
+//record kinds, the low 2 bits of the first varint
+#define BME280_STREAM_DEVICE 0
+#define BME280_STREAM_DELTA 1 //a sample timed relative to the previous one
+#define BME280_STREAM_ABSOLUTE 2 //a sample timed since the epoch
+
+struct StreamSample
+{
+	int64_t time_ns; //CLOCK_REALTIME of the sample, kept to the us
+	uint32_t p; //pressure, same units as struct Data
+	int32_t t; //temperature
+	uint32_t h; //humidity
+};
+
+//the values the next record is relative to, on both ends of a stream
+struct StreamState
+{
+	int64_t time_us; //of the last sample record, 0 before the first
+	bool named[BME280_STREAM_MAX_DEVICES];
+	char names[BME280_STREAM_MAX_DEVICES][32];
+	struct StreamSample last[BME280_STREAM_MAX_DEVICES];
+};
+
+static inline int putVarint(uint8_t * p, uint64_t v) {
+	int n = 0;
+	for (; v >= 0x80; v >>= 7) p[n++] = (v & 0x7F) | 0x80;
+	p[n++] = v;
+	return n;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+//returns false at the end of the stream or on a varint longer than 64 bits
+static inline bool getVarint(FILE * f, uint64_t * v) {
+	int c;
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if ((c = fgetc(f)) == EOF) return false;
+		*v |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return true;
+	}
+	return false;
+}
+
+static inline bool writeStreamHeader(FILE * f) {
+	uint8_t hdr[5] = { 'B', 'E', '2', 'S', BME280_STREAM_VERSION };
+	return fwrite(hdr, sizeof(hdr), 1, f) == 1;
+}
+
+static inline bool readStreamHeader(FILE * f) {
+	uint8_t hdr[5];
+	return fread(hdr, sizeof(hdr), 1, f) == 1 && memcmp(hdr, "BE2S", 4) == 0 && hdr[4] == BME280_STREAM_VERSION;
+}
+
+//writes the device record first if the device has none yet
+static inline bool writeStreamSample(FILE * f, struct StreamState * st, uint8_t id, const char * name, const struct StreamSample * s) {
+	uint8_t rec[BME280_STREAM_MAX_RECORD + sizeof(st->names[0])];
+	int n = 0;
+	if (id >= BME280_STREAM_MAX_DEVICES) return false;
+	if (!st->named[id]) {
+		size_t len = strlen(name) < sizeof(st->names[0]) ? strlen(name) : sizeof(st->names[0]) - 1;
+		n += putVarint(rec + n, (uint64_t)id << 2 | BME280_STREAM_DEVICE);
+		n += putVarint(rec + n, len);
+		memcpy(rec + n, name, len);
+		n += len;
+		st->named[id] = true;
+	}
+	struct StreamSample * last = &st->last[id];
+	int64_t time_us = s->time_ns / 1000;
+	bool delta = st->time_us && time_us >= st->time_us;
+	n += putVarint(rec + n, (uint64_t)id << 2 | (delta ? BME280_STREAM_DELTA : BME280_STREAM_ABSOLUTE));
+	n += putVarint(rec + n, delta ? time_us - st->time_us : time_us);
+	n += putVarint(rec + n, zigzag((int64_t)s->t - last->t));
+	n += putVarint(rec + n, zigzag((int64_t)s->p - last->p));
+	n += putVarint(rec + n, zigzag((int64_t)s->h - last->h));
+	st->time_us = time_us;
+	*last = *s;
+	return fwrite(rec, n, 1, f) == 1;
+}
+
+//returns 1 with the next sample, its device id and name, 0 at the end of the stream and -1 on a malformed record
+static inline int readStreamSample(FILE * f, struct StreamState * st, uint8_t * id, const char ** name, struct StreamSample * s) {
+	uint64_t tag, v[4];
+	while (getVarint(f, &tag)) {
+		if ((tag >> 2) >= BME280_STREAM_MAX_DEVICES || (tag & 3) > BME280_STREAM_ABSOLUTE) return -1;
+		*id = tag >> 2;
+		if ((tag & 3) == BME280_STREAM_DEVICE) {
+			if (!getVarint(f, &v[0]) || v[0] >= sizeof(st->names[0]) || fread(st->names[*id], 1, v[0], f) != v[0]) return -1;
+			st->names[*id][v[0]] = 0;
+			st->named[*id] = true;
+			continue;
+		}
+		for (int i = 0; i < 4; i++)
+			if (!getVarint(f, &v[i])) return -1;
+		if (!st->named[*id]) return -1;
+		int64_t time_us = (tag & 3) == BME280_STREAM_DELTA ? st->time_us + (int64_t)v[0] : (int64_t)v[0];
+		struct StreamSample * last = &st->last[*id];
+		last->time_ns = time_us * 1000;
+		last->t += unzigzag(v[1]);
+		last->p += unzigzag(v[2]);
+		last->h += unzigzag(v[3]);
+		st->time_us = time_us;
+		*name = st->names[*id];
+		*s = *last;
+		return 1;
+	}
+	return 0;
+}
+
+#endif
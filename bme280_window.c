@@ -0,0 +1,181 @@
+//Streaming aggregation windows, see bme280_window.h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "bme280_window.h"
+
+#define WINDOW_SLACK 4 //extra samples kept for timestamps jittering around the window edges
+
+static int64_t getValue(const struct Data * data, int c) {
+	return c == 0 ? data->t : c == 1 ? (int64_t)data->p : (int64_t)data->h;
+}
+
+static void setValue(struct Data * data, int c, int64_t v) {
+	if (c == 0) data->t = v;
+	else if (c == 1) data->p = v;
+	else data->h = v;
+}
+
+//appends seq after dropping the samples it dominates, they can never be the extreme of a later window
+static void pushDeque(struct Window * w, struct Deque * d, int c, uint64_t seq, bool isMin) {
+	int64_t v = w->values[c][seq % w->cap];
+	while (d->len > 0) {
+		int64_t back = w->values[c][d->seq[(d->head + d->len - 1) % w->cap] % w->cap];
+		if (isMin ? back < v : back > v) break;
+		d->len--;
+	}
+	d->seq[(d->head + d->len++) % w->cap] = seq;
+}
+
+static void popDeque(struct Window * w, struct Deque * d, uint64_t seq) {
+	if (d->len > 0 && d->seq[d->head] == seq) {
+		d->head = (d->head + 1) % w->cap;
+		d->len--;
+	}
+}
+
+static int64_t frontDeque(const struct Window * w, const struct Deque * d, int c) {
+	return w->values[c][d->seq[d->head] % w->cap];
+}
+
+static void evictOldest(struct Window * w) {
+	uint64_t seq = w->first++;
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		w->sum[c] -= w->values[c][seq % w->cap];
+		popDeque(w, &w->min[c], seq);
+		popDeque(w, &w->max[c], seq);
+	}
+}
+
+//drops the samples before the start of the window ending at w->next_ns
+static void evict(struct Window * w) {
+	int64_t start = w->next_ns - (int64_t)w->length_ns;
+	while (w->first < w->next && w->time_ns[w->first % w->cap] < start) evictOldest(w);
+}
+
+//moves the part of a deque wrapped around the end of a ring of cap entries to the second half of a doubled one
+static void unwrapDeque(struct Deque * d, uint32_t cap) {
+	if (d->head + d->len > cap) memcpy(d->seq + cap, d->seq, (d->head + d->len - cap) * sizeof(uint64_t));
+}
+
+//doubles the ring when a window holds more samples than the sampling interval allows, i.e. after a stalled bus
+//the samples whose index seq % cap changes move to the new half
+static bool growWindow(struct Window * w) {
+	uint32_t cap = w->cap * 2;
+	int64_t * v;
+	uint64_t * seq;
+	if (cap < w->cap || !(v = realloc(w->time_ns, cap * sizeof(int64_t)))) return false;
+	w->time_ns = v;
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		if (!(v = realloc(w->values[c], cap * sizeof(int64_t)))) return false;
+		w->values[c] = v;
+		if (!(seq = realloc(w->min[c].seq, cap * sizeof(uint64_t)))) return false;
+		w->min[c].seq = seq;
+		if (!(seq = realloc(w->max[c].seq, cap * sizeof(uint64_t)))) return false;
+		w->max[c].seq = seq;
+	}
+	for (uint64_t i = w->first; i < w->next; i++) {
+		if (i % cap == i % w->cap) continue;
+		w->time_ns[i % cap] = w->time_ns[i % w->cap];
+		for (int c = 0; c < WINDOW_CHANNELS; c++) w->values[c][i % cap] = w->values[c][i % w->cap];
+	}
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		unwrapDeque(&w->min[c], w->cap);
+		unwrapDeque(&w->max[c], w->cap);
+	}
+	w->cap = cap;
+	return true;
+}
+
+bool initWindow(struct Window * w, uint64_t length_ns, uint64_t step_ns, uint32_t interval_us) {
+	memset(w, 0, sizeof(struct Window));
+	if (length_ns == 0 || step_ns == 0 || step_ns > length_ns) return false;
+	w->length_ns = length_ns;
+	w->step_ns = step_ns;
+	w->cap = length_ns / ((uint64_t)interval_us * 1000) + WINDOW_SLACK;
+	w->time_ns = malloc(w->cap * sizeof(int64_t));
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		w->values[c] = malloc(w->cap * sizeof(int64_t));
+		w->min[c].seq = malloc(w->cap * sizeof(uint64_t));
+		w->max[c].seq = malloc(w->cap * sizeof(uint64_t));
+	}
+	return true;
+}
+
+void freeWindow(struct Window * w) {
+	free(w->time_ns);
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		free(w->values[c]);
+		free(w->min[c].seq);
+		free(w->max[c].seq);
+	}
+}
+
+bool popWindow(struct Window * w, int64_t time_ns, struct WindowData * agg) {
+	if (w->next_ns == 0) w->next_ns = (time_ns / (int64_t)w->step_ns + 1) * w->step_ns;
+	if (time_ns < w->next_ns) return false;
+	evict(w);
+	uint32_t count = w->next - w->first;
+	if (count == 0) {
+		//later windows ending by time_ns start even later, they are empty too
+		w->next_ns += ((time_ns - w->next_ns) / w->step_ns + 1) * w->step_ns;
+		return false;
+	}
+	agg->start_ns = w->next_ns - w->length_ns;
+	agg->end_ns = w->next_ns;
+	agg->count = count;
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		setValue(&agg->min, c, frontDeque(w, &w->min[c], c));
+		setValue(&agg->max, c, frontDeque(w, &w->max[c], c));
+		//rounded to nearest, t may be negative
+		int64_t s = w->sum[c];
+		setValue(&agg->avg, c, (s >= 0 ? s + count / 2 : s - count / 2) / (int64_t)count);
+	}
+	w->next_ns += w->step_ns;
+	return true;
+}
+
+void pushWindow(struct Window * w, int64_t time_ns, const struct Data * data) {
+	evict(w);
+	if (w->next - w->first == w->cap && !growWindow(w)) {
+		printf("pushWindow() out of memory, the oldest sample is left out of the window\n");
+		evictOldest(w);
+	}
+	uint64_t seq = w->next++;
+	w->time_ns[seq % w->cap] = time_ns;
+	for (int c = 0; c < WINDOW_CHANNELS; c++) {
+		int64_t v = getValue(data, c);
+		w->values[c][seq % w->cap] = v;
+		w->sum[c] += v;
+		pushDeque(w, &w->min[c], c, seq, true);
+		pushDeque(w, &w->max[c], c, seq, false);
+	}
+}
+
+bool parseDuration(const char * arg, const char * end, uint64_t * ns) {
+	char * unit;
+	double v = strtod(arg, &unit);
+	size_t len = end - unit;
+	if (unit == arg || v <= 0) return false;
+	if (len == 0 || (len == 1 && *unit == 's')) v *= 1e9;
+	else if (len == 2 && strncasecmp(unit, "ms", 2) == 0) v *= 1e6;
+	else if (len == 1 && *unit == 'm') v *= 60e9;
+	else if (len == 1 && *unit == 'h') v *= 3600e9;
+	else return false;
+	*ns = v;
+	return *ns > 0;
+}
+
+bool parseWindow(const char * arg, uint64_t * length_ns, uint64_t * step_ns) {
+	const char * slash = strchr(arg, '/');
+	if (!parseDuration(arg, slash ? slash : arg + strlen(arg), length_ns)) return false;
+	if (!slash) {
+		*step_ns = *length_ns;
+		return true;
+	}
+	return parseDuration(slash + 1, slash + 1 + strlen(slash + 1), step_ns) && *step_ns <= *length_ns;
+}
@@ -0,0 +1,67 @@
+//Streaming min/max/avg aggregation of samples over time windows ("bme280 --window")
+//A window of length L is emitted every step S, aligned to multiples of S in CLOCK_REALTIME (every full minute for S = 1m).
+//S = L gives tumbling windows, S < L sliding ones. Each sample costs O(1) amortized: min and max are kept in monotonic
+//deques, the average in a running sum, so high rate sampling feeds accurate extremes to coarse archives such as RRD.
+
+#ifndef BME280_WINDOW_H
+#define BME280_WINDOW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bme280.h"
+
+#define WINDOW_CHANNELS 3 //t, p, h
+
+//sequence numbers of samples in the window whose values are monotonic from front to back
+struct Deque
+{
+	uint64_t * seq;
+	uint32_t head;
+	uint32_t len;
+};
+
+struct Window
+{
+	uint64_t length_ns;
+	uint64_t step_ns;
+	int64_t next_ns; //end of the window emitted next, 0 before the first sample
+	uint32_t cap; //samples kept, the window length divided by the sampling interval plus slack, doubled when exceeded
+	uint64_t first; //sequence number of the oldest sample in the window
+	uint64_t next; //of the next sample
+	int64_t * time_ns; //ring of cap samples, indexed by sequence number % cap
+	int64_t * values[WINDOW_CHANNELS];
+	int64_t sum[WINDOW_CHANNELS];
+	struct Deque min[WINDOW_CHANNELS];
+	struct Deque max[WINDOW_CHANNELS];
+};
+
+//aggregate of the samples with time in [start_ns, end_ns)
+struct WindowData
+{
+	int64_t start_ns;
+	int64_t end_ns;
+	uint32_t count;
+	struct Data min;
+	struct Data max;
+	struct Data avg;
+};
+
+//interval_us is the sampling interval, it bounds the number of samples a window holds
+bool initWindow(struct Window * w, uint64_t length_ns, uint64_t step_ns, uint32_t interval_us);
+void freeWindow(struct Window * w);
+
+//returns true and fills agg with the next window that ended before a sample taken at time_ns and still has samples,
+//call it until it returns false before pushWindow(), after a gap sliding windows overlapping it are emitted one by one,
+//windows without samples are skipped
+bool popWindow(struct Window * w, int64_t time_ns, struct WindowData * agg);
+
+//adds a sample taken at time_ns
+void pushWindow(struct Window * w, int64_t time_ns, const struct Data * data);
+
+//parses <length>[/<step>], each a number with an optional unit ms, s (default), m or h, i.e. 1m or 1h/1m
+bool parseWindow(const char * arg, uint64_t * length_ns, uint64_t * step_ns);
+
+//parses a number with an optional unit ms, s (default), m or h that ends at end
+bool parseDuration(const char * arg, const char * end, uint64_t * ns);
+
+#endif
@@ -0,0 +1,78 @@
+//bme280c - prints the latest sample published by "bme280 <i2c-dev> <sampling_rate_sec> --daemon"
+//Reads shared memory only, so it causes no I2C traffic and any number of clients can run at once
+//gcc -O3 -o bme280c bme280c.c -lrt
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "bme280_shm.h"
+
+#define BME280_I2C_ADDR_PRIM 0x76
+
+//same output as printData() in bme280.c
+void printSample(const struct ShmSample * sample, bool raw) {
+	double t, p, h;
+	uint8_t deg[3] = { 0xc2, 0xb0, 0 }; //unicode degree symbol
+	t = sample->t / 100.0;
+	p = sample->p / 256.0;
+	h = sample->h / 1024.0;
+
+	if (raw)
+		printf("t=%.1f&h=%.1f&p=%.1f\n", t, h, p / 100);
+	else
+		printf("T = %.1f%sC, H = %.1f%%, P = %.1fmb(hPa) (%.1fmm Hg)\n", t, (char *)(&deg), h, p / 100, p * 0.0075006157584566);
+}
+
+int main(int argc, char ** argv) {
+	bool raw = false;
+	if (argc < 2 || argc > 3 || (argc == 3 && strncmp(argv[2], "--raw", 5) != 0)) {
+		printf("Usage: bme280c <i2c-dev>[:addr] [--raw]\n");
+		return -1;
+	}
+	if (argc == 3) raw = true;
+
+	//same device syntax as bme280, i.e. /dev/i2c-1:77
+	char name[64], * colon = strchr(argv[1], ':');
+	uint16_t addr = BME280_I2C_ADDR_PRIM;
+	if (colon) {
+		*colon = 0;
+		addr = strtoul(colon + 1, NULL, 16);
+	}
+	getShmName(argv[1], addr, name, sizeof(name));
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		perror("Unable to open shared memory, is bme280 --daemon running");
+		return -1;
+	}
+	const struct Shm * shm = mmap(NULL, sizeof(struct Shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		perror("mmap shm failed");
+		return -1;
+	}
+	if (shm->magic != BME280_SHM_MAGIC || shm->version != BME280_SHM_VERSION) {
+		printf("error: %s is not a bme280 version %d segment\n", name, BME280_SHM_VERSION);
+		return -1;
+	}
+
+	struct ShmSample sample;
+	if (!readShm(shm, &sample)) {
+		printf("error: no sample published yet\n");
+		return -1;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	int64_t age_ms = ((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - sample.time_ns) / 1000000;
+	if (age_ms > (int64_t)BME280_SHM_MAX_AGE_INTERVALS * shm->interval_ms + 1000) {
+		printf("error: sample is stale (%lld ms old)\n", (long long)age_ms);
+		return -1;
+	}
+	printSample(&sample, raw);
+	return 0;
+}
@@ -0,0 +1,151 @@
+//bme280log - exports a time range of a binary log written by "bme280 --log <file>" as CSV or JSON
+//The range is located by binary search over the sparse time index, so only the requested records are touched
+//gcc -O3 -o bme280log bme280log.c
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bme280_log.h"
+
+//seconds since epoch, negative values are relative to now, i.e. -3600 is an hour ago
+bool parseTime(const char * arg, int64_t * time_ns) {
+	char * end;
+	double v = strtod(arg, &end);
+	if (end == arg || *end) return false;
+	if (v < 0) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		v += now.tv_sec + now.tv_nsec / 1e9;
+	}
+	*time_ns = (int64_t)(v * 1e9);
+	return true;
+}
+
+//first record number with time_ns >= from, records first..count-1 are in the log
+uint64_t findRecord(void * map, uint64_t first, uint64_t count, int64_t from) {
+	struct LogHeader * hdr = map;
+	const int64_t * index = getLogIndex(map);
+	const struct LogRecord * recs = getLogRecords(map);
+	uint64_t idxLen = getLogIndexLen(hdr->capacity);
+	//index entry i holds the time of record i * stride, search the last one not after from
+	uint64_t lo = (first + BME280_LOG_INDEX_STRIDE - 1) / BME280_LOG_INDEX_STRIDE, hi = (count - 1) / BME280_LOG_INDEX_STRIDE + 1;
+	uint64_t n = first;
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (index[mid % idxLen] <= from) {
+			n = mid * BME280_LOG_INDEX_STRIDE;
+			lo = mid + 1;
+		} else
+			hi = mid;
+	}
+	while (n < count && recs[n % hdr->capacity].time_ns < from) n++;
+	return n;
+}
+
+const char * getTransportName(uint8_t transport) {
+	switch (transport) {
+	case BME280_LOG_I2C: return "i2c";
+	case BME280_LOG_SPI: return "spi";
+	case BME280_LOG_EMU: return "emu";
+	case BME280_LOG_EMU_SPI: return "emu-spi";
+	default: return "unknown";
+	}
+}
+
+void printRecord(const struct LogRecord * rec, bool json, bool first) {
+	long long sec = rec->time_ns / 1000000000;
+	int ms = (rec->time_ns % 1000000000) / 1000000;
+	if (json)
+		printf("%s\n{\"time\":%lld.%03d,\"transport\":\"%s\",\"bus\":%u,\"addr\":\"%02x\",\"raw_t\":%u,\"raw_h\":%u,\"raw_p\":%u,\"t\":%.2f,\"h\":%.3f,\"p\":%.4f}",
+			first ? "" : ",", sec, ms, getTransportName(rec->transport), rec->bus, rec->addr, rec->raw_t, rec->raw_h, rec->raw_p, rec->t / 100.0, rec->h / 1024.0, rec->p / 25600.0);
+	else
+		printf("%lld.%03d,%s,%u,%02x,%u,%u,%u,%.2f,%.3f,%.4f\n",
+			sec, ms, getTransportName(rec->transport), rec->bus, rec->addr, rec->raw_t, rec->raw_h, rec->raw_p, rec->t / 100.0, rec->h / 1024.0, rec->p / 25600.0);
+}
+
+void usage() {
+	printf("Usage: bme280log <file> [--from <time>] [--to <time>] [--csv|--json]\n");
+	printf("  time is seconds since epoch or, if negative, relative to now (--from -3600 is the last hour)\n");
+	printf("  transport is i2c, spi, emu or emu-spi, bus and addr are N and the address of /dev/i2c-N or B and C of /dev/spidevB.C\n");
+	printf("  t is in deg C, h in %%, p in hPa (mb), raw_* are the uncompensated ADC values\n");
+}
+
+int main(int argc, char ** argv) {
+	int opt;
+	bool json = false;
+	int64_t from = INT64_MIN, to = INT64_MAX;
+	static struct option options[] = {
+		{ "from", required_argument, NULL, 'f' },
+		{ "to", required_argument, NULL, 't' },
+		{ "csv", no_argument, NULL, 'c' },
+		{ "json", no_argument, NULL, 'j' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!parseTime(optarg, &from)) { usage(); return -1; }
+			break;
+		case 't':
+			if (!parseTime(optarg, &to)) { usage(); return -1; }
+			break;
+		case 'c': json = false; break;
+		case 'j': json = true; break;
+		default: usage(); return -1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return -1;
+	}
+
+	int fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		perror("Unable to open log");
+		return -1;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	if ((uint64_t)st.st_size < BME280_LOG_HEADER_SIZE) {
+		printf("error: %s is not a bme280 log\n", argv[optind]);
+		return -1;
+	}
+	void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap log failed");
+		return -1;
+	}
+	struct LogHeader * hdr = map;
+	if (hdr->magic != BME280_LOG_MAGIC || hdr->version != BME280_LOG_VERSION || hdr->record_size != sizeof(struct LogRecord)
+		|| hdr->index_stride != BME280_LOG_INDEX_STRIDE || getLogFileSize(hdr->capacity) != (uint64_t)st.st_size) {
+		printf("error: %s is not a bme280 version %d log\n", argv[optind], BME280_LOG_VERSION);
+		return -1;
+	}
+
+	//the log may be written to while it is read, the oldest record is skipped as it may be being overwritten
+	uint64_t count = atomic_load_explicit(&hdr->count, memory_order_acquire);
+	uint64_t first = count > hdr->capacity ? count - hdr->capacity + 1 : 0;
+	const struct LogRecord * recs = getLogRecords(map);
+	uint64_t n = count > first ? findRecord(map, first, count, from) : count;
+
+	if (json) printf("[");
+	else printf("time,transport,bus,addr,raw_t,raw_h,raw_p,t,h,p\n");
+	bool firstOut = true;
+	for (; n < count && recs[n % hdr->capacity].time_ns <= to; n++) {
+		printRecord(&recs[n % hdr->capacity], json, firstOut);
+		firstOut = false;
+	}
+	if (json) printf("\n]\n");
+	return 0;
+}
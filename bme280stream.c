@@ -0,0 +1,72 @@
+//bme280stream - prints a delta stream written by "bme280 --stream <file>" as CSV or JSON lines
+//Reads a file or, without one, stdin, i.e. "bme280 /dev/i2c-1 10hz 0 --deadband t=0.1 --stream - | bme280stream"
+//Lines are flushed as samples arrive, so it can sit at the end of a pipe
+//gcc -O3 -o bme280stream bme280stream.c
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "bme280_stream.h"
+
+void printSample(const char * name, const struct StreamSample * s, bool json) {
+	long long sec = s->time_ns / 1000000000;
+	int ms = (s->time_ns % 1000000000) / 1000000;
+	if (json)
+		printf("{\"time\":%lld.%03d,\"dev\":\"%s\",\"t\":%.2f,\"h\":%.3f,\"p\":%.4f}\n", sec, ms, name, s->t / 100.0, s->h / 1024.0, s->p / 25600.0);
+	else
+		printf("%lld.%03d,%s,%.2f,%.3f,%.4f\n", sec, ms, name, s->t / 100.0, s->h / 1024.0, s->p / 25600.0);
+}
+
+void usage() {
+	printf("Usage: bme280stream [<file>] [--csv|--json]\n");
+	printf("  reads stdin without a file, t is in deg C, h in %%, p in hPa (mb)\n");
+}
+
+int main(int argc, char ** argv) {
+	int opt, res;
+	bool json = false;
+	static struct option options[] = {
+		{ "csv", no_argument, NULL, 'c' },
+		{ "json", no_argument, NULL, 'j' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (opt) {
+		case 'c': json = false; break;
+		case 'j': json = true; break;
+		default: usage(); return -1;
+		}
+	}
+	if (optind < argc - 1) {
+		usage();
+		return -1;
+	}
+
+	FILE * f = optind == argc ? stdin : fopen(argv[optind], "rb");
+	if (!f) {
+		perror("Unable to open stream");
+		return -1;
+	}
+	if (!readStreamHeader(f)) {
+		fprintf(stderr, "error: %s is not a bme280 version %d stream\n", optind == argc ? "stdin" : argv[optind], BME280_STREAM_VERSION);
+		return -1;
+	}
+
+	static struct StreamState st;
+	struct StreamSample s;
+	const char * name;
+	uint8_t id;
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if (!json) printf("time,dev,t,h,p\n");
+	while ((res = readStreamSample(f, &st, &id, &name, &s)) == 1) printSample(name, &s, json);
+	if (res < 0) {
+		fprintf(stderr, "error: malformed record\n");
+		return -1;
+	}
+	return 0;
+}